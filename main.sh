@@ -1,11 +1,12 @@
 #!/bin/bash
 
 show_help() {
-    echo "Usage: ./main.sh [-compile] [-name <name>] [-h]"
+    echo "Usage: ./main.sh [-compile] [-name <name>] [-resume] [-h]"
     echo ""
     echo "Options:"
     echo "  -compile           Compiles the project before running. (optional)"
     echo "  -name <name>       Specify a name that ends in '.png' (optional)"
+    echo "  -resume            Continue from the last checkpoint in temp/ (optional)"
     echo "  -h                 Show this help message (optional)"
     echo ""
     echo "Example:"
@@ -15,12 +16,18 @@ show_help() {
 
 compile(){
     echo "Compiling."
-    clang++ -std=c++11 src/*.cpp -o main -O3
+    # Lets the BVH box tests use AVX or SSE on x86. Other platforms use the scalar fallback.
+    arch_flags=""
+    if [[ "$(uname -m)" == "x86_64" ]]; then
+        arch_flags="-march=native"
+    fi
+    clang++ -std=c++11 src/*.cpp -o main -O3 $arch_flags
     echo "Finished compiling."
 }
 
 
 name="result.png"
+main_args=""
 echo ""
 
 # Parse arguments. Compiles project if compile flag is set. Also sets resulting image name if provided.
@@ -33,6 +40,9 @@ while [[ "$#" -gt 0 ]]; do
             name="$2"
             shift
             ;;
+        -resume)
+            main_args="--resume"
+            ;;
         -h)
             show_help
             exit 0
@@ -50,5 +60,5 @@ if [[ "$name" != *.png ]]; then
 fi
 
 echo "Running program. The result can be found in Images/$name"
-width=$(./main)
+width=$(./main $main_args)
 python python_utils/to_png.py --name $name --width $width
@@ -0,0 +1,51 @@
+#include "accumulator.h"
+#include <algorithm>
+#include <limits>
+
+
+double luminance(const vec3& rgb){
+    return 0.2126 * rgb[0] + 0.7152 * rgb[1] + 0.0722 * rgb[2];
+}
+
+
+void PixelAccumulator::add_sample(const PixelData& data){
+    double sample_luminance = luminance(data.pixel_color);
+    color_sum += data.pixel_color;
+    position_sum += data.pixel_position;
+    normal_sum += data.pixel_normal;
+    luminance_sum += sample_luminance;
+    luminance_squared_sum += sample_luminance * sample_luminance;
+    number_of_samples++;
+}
+
+PixelData PixelAccumulator::get_mean() const{
+    PixelData data;
+    if (number_of_samples == 0){
+        return data;
+    }
+    data.pixel_color = color_sum / (double) number_of_samples;
+    data.pixel_position = position_sum / (double) number_of_samples;
+    data.pixel_normal = normal_sum / (double) number_of_samples;
+    return data;
+}
+
+double PixelAccumulator::get_variance() const{
+    // Unbiased sample variance of the luminance.
+    if (number_of_samples < 2){
+        return 0;
+    }
+    double mean = luminance_sum / number_of_samples;
+    double variance = (luminance_squared_sum - number_of_samples * mean * mean) / (number_of_samples - 1);
+    return std::max(variance, 0.0);
+}
+
+double PixelAccumulator::get_relative_error() const{
+    // Standard error of the mean luminance relative to the mean. The small offset keeps nearly black pixels from
+    // demanding samples forever.
+    if (number_of_samples < 2){
+        return std::numeric_limits<double>::infinity();
+    }
+    double mean = luminance_sum / number_of_samples;
+    double standard_error = sqrt(get_variance() / number_of_samples);
+    return standard_error / (mean + 0.001);
+}
@@ -0,0 +1,33 @@
+#ifndef ACCUMULATOR_H
+#define ACCUMULATOR_H
+
+#include "vec3.h"
+#include "constants.h"
+
+
+struct PixelData{
+    vec3 pixel_color = vec3(0,0,0);
+    vec3 pixel_position = vec3(0,0,0);
+    vec3 pixel_normal = vec3(0,0,0);
+};
+
+
+struct PixelAccumulator{
+    // Running sums over all samples of a pixel, in linear (not tone mapped) color.
+    vec3 color_sum = vec3(0,0,0);
+    vec3 position_sum = vec3(0,0,0);
+    vec3 normal_sum = vec3(0,0,0);
+    double luminance_sum = 0;
+    double luminance_squared_sum = 0;
+    int number_of_samples = 0;
+
+    void add_sample(const PixelData& data);
+    PixelData get_mean() const;
+    double get_variance() const;
+    double get_relative_error() const;
+};
+
+
+double luminance(const vec3& rgb);
+
+#endif
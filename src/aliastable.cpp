@@ -0,0 +1,77 @@
+#include "aliastable.h"
+#include <algorithm>
+
+
+AliasTable::AliasTable(const std::vector<double>& weights){
+    int n = weights.size();
+    probabilities.resize(n);
+    aliases.resize(n);
+    pdfs.resize(n);
+    if (n == 0){
+        return;
+    }
+
+    double total_weight = 0;
+    for (int i = 0; i < n; i++){
+        total_weight += weights[i];
+    }
+    for (int i = 0; i < n; i++){
+        pdfs[i] = total_weight > 0 ? weights[i] / total_weight : 1.0 / n;
+    }
+
+    // Vose's method: buckets below the average are topped up from ones above it, which then move to the list they
+    // fall into. Whatever is left over is one up to rounding.
+    std::vector<double> scaled(n);
+    std::vector<int> small;
+    std::vector<int> large;
+    for (int i = 0; i < n; i++){
+        scaled[i] = pdfs[i] * n;
+        if (scaled[i] < 1){
+            small.push_back(i);
+        }
+        else{
+            large.push_back(i);
+        }
+    }
+    while (!small.empty() && !large.empty()){
+        int lower = small.back();
+        small.pop_back();
+        int upper = large.back();
+        probabilities[lower] = scaled[lower];
+        aliases[lower] = upper;
+        scaled[upper] -= 1 - scaled[lower];
+        if (scaled[upper] < 1){
+            large.pop_back();
+            small.push_back(upper);
+        }
+    }
+    for (size_t i = 0; i < large.size(); i++){
+        probabilities[large[i]] = 1;
+        aliases[large[i]] = large[i];
+    }
+    for (size_t i = 0; i < small.size(); i++){
+        probabilities[small[i]] = 1;
+        aliases[small[i]] = small[i];
+    }
+}
+
+int AliasTable::sample(Sampler& sampler, double& pdf) const{
+    return sample(sampler.random_uniform(0, 1), pdf);
+}
+
+int AliasTable::sample(const double u, double& pdf) const{
+    int n = probabilities.size();
+    double scaled = u * n;
+    int bucket = std::min(int(scaled), n - 1);
+    int index = scaled - bucket < probabilities[bucket] ? bucket : aliases[bucket];
+    pdf = pdfs[index];
+    return index;
+}
+
+double AliasTable::pdf(const int index) const{
+    return pdfs[index];
+}
+
+int AliasTable::size() const{
+    return pdfs.size();
+}
@@ -0,0 +1,27 @@
+#ifndef ALIASTABLE_H
+#define ALIASTABLE_H
+
+#include <vector>
+#include "sampler.h"
+
+
+class AliasTable{
+    // Draws index i with probability proportional to weights[i] in constant time, using one random number. The number
+    // picks a bucket, and its fraction within the bucket decides between the bucket's own index and its alias. Falls
+    // back to a uniform distribution when all weights are zero.
+    public:
+        AliasTable(){}
+        AliasTable(const std::vector<double>& weights);
+
+        int sample(Sampler& sampler, double& pdf) const;
+        int sample(const double u, double& pdf) const;
+        double pdf(const int index) const;
+        int size() const;
+
+    private:
+        std::vector<double> probabilities; // Chance of keeping the bucket's own index.
+        std::vector<int> aliases;
+        std::vector<double> pdfs;
+};
+
+#endif
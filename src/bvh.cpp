@@ -1,216 +1,655 @@
 #include "bvh.h"
+#include <algorithm>
+#include <iostream>
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 
 namespace BVH{
-    vec3 get_max_point(Object** triangles, int number_of_triangles){
-        if (number_of_triangles == 0){
-            return vec3(0,0,0);
-        }
-        vec3 max_point = triangles[0] -> max_axis_point();
-        for (int i = 1; i < number_of_triangles; i++){
-            vec3 this_max_point = triangles[i] -> max_axis_point();
-            for (int j = 0; j < 3; j++){
-                max_point.e[j] = std::max(this_max_point[j], max_point[j]);
-            }
+    AxisAlignedBox empty_box(){
+        AxisAlignedBox box;
+        box.min_point = vec3(constants::max_ray_distance);
+        box.max_point = vec3(-constants::max_ray_distance);
+        return box;
+    }
+
+
+    void grow_box(AxisAlignedBox& box, const AxisAlignedBox& other){
+        for (int i = 0; i < 3; i++){
+            box.min_point.e[i] = std::min(box.min_point[i], other.min_point[i]);
+            box.max_point.e[i] = std::max(box.max_point[i], other.max_point[i]);
         }
-        return max_point + vec3(constants::EPSILON);
     }
 
 
-    vec3 get_min_point(Object** triangles, int number_of_triangles){
-        if (number_of_triangles == 0){
-            return vec3(0,0,0);
+    void grow_box(AxisAlignedBox& box, const vec3& point){
+        for (int i = 0; i < 3; i++){
+            box.min_point.e[i] = std::min(box.min_point[i], point[i]);
+            box.max_point.e[i] = std::max(box.max_point[i], point[i]);
         }
-        vec3 min_point = triangles[0] -> min_axis_point();
-        for (int i = 1; i < number_of_triangles; i++){
-            vec3 this_min_point = triangles[i] -> min_axis_point();
-            for (int j = 0; j < 3; j++){
-                min_point.e[j] = std::min(this_min_point[j], min_point[j]);
-            }
+    }
+
+
+    double surface_area(const AxisAlignedBox& box){
+        vec3 extent = box.max_point - box.min_point;
+        if (extent[0] < 0 || extent[1] < 0 || extent[2] < 0){
+            return 0;
         }
-        return min_point - vec3(constants::EPSILON);
+        return 2.0 * (extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0]);
     }
 
 
-    BoundingBox::BoundingBox(Object** _triangles, int number_of_triangles){
-        p1 = get_min_point(_triangles, number_of_triangles);
-        p2 = get_max_point(_triangles, number_of_triangles);
-        x_interval = Interval(p1[0], p2[0]);
-        y_interval = Interval(p1[1], p2[1]);
-        z_interval = Interval(p1[2], p2[2]);
+    int compute_bin(const vec3& centroid, const AxisAlignedBox& centroid_bounds, const int axis){
+        double extent = centroid_bounds.max_point[axis] - centroid_bounds.min_point[axis];
+        int bin = constants::bvh_number_of_bins * ((centroid[axis] - centroid_bounds.min_point[axis]) / extent);
+        return std::min(std::max(bin, 0), constants::bvh_number_of_bins - 1);
+    }
 
-        width = p2[0] - p1[0];
-        length = p2[1] - p1[1];
-        height = p2[2] - p1[2];
 
-        axis_length[0] = width;
-        axis_length[1] = length;
-        axis_length[2] = height;
+    void clear_bins(BinData& bins){
+        for (int axis = 0; axis < 3; axis++){
+            for (int i = 0; i < constants::bvh_number_of_bins; i++){
+                bins.counts[axis][i] = 0;
+                bins.bounds[axis][i] = empty_box();
+            }
+        }
     }
 
-    Interval BoundingBox::get_interval(const int axis) const{
-        if (axis == 0){
-            return x_interval;
+
+    void merge_bins(BinData& bins, const BinData& other){
+        for (int axis = 0; axis < 3; axis++){
+            for (int i = 0; i < constants::bvh_number_of_bins; i++){
+                bins.counts[axis][i] += other.counts[axis][i];
+                grow_box(bins.bounds[axis][i], other.bounds[axis][i]);
+            }
         }
-        else if (axis == 1){
-            return y_interval;
+    }
+
+
+    void bin_primitives(const std::vector<BuildPrimitive>& build_primitives, const int start, const int end, const AxisAlignedBox& centroid_bounds, BinData& bins){
+        for (int axis = 0; axis < 3; axis++){
+            if (centroid_bounds.max_point[axis] <= centroid_bounds.min_point[axis]){
+                continue;
+            }
+            for (int i = start; i < end; i++){
+                int bin = compute_bin(build_primitives[i].centroid, centroid_bounds, axis);
+                bins.counts[axis][bin]++;
+                grow_box(bins.bounds[axis][bin], build_primitives[i].bounds);
+            }
         }
-        return z_interval;
     }
 
-    bool BoundingBox::intersect(Ray& ray, double& distance) const{
-        Interval ray_interval(0, constants::max_ray_distance);
+
+    int number_of_groups(const int number_of_primitives, const int group_size){
+        return (number_of_primitives + group_size - 1) / group_size;
+    }
+
+
+    SplitCandidate find_best_split(const BinData& bins, const AxisAlignedBox& bounds, const AxisAlignedBox& centroid_bounds, const int number_of_node_primitives, const int group_size){
+        // Evaluates the surface area heuristic at every bin boundary along each axis:
+        // cost = traversal + (A_left * N_left + A_right * N_right) / A_node * intersection,
+        // where N counts groups of primitives that are intersected together.
+        const int number_of_bins = constants::bvh_number_of_bins;
+        SplitCandidate best_split;
+        double node_area = surface_area(bounds);
+        if (node_area <= 0){
+            return best_split;
+        }
 
         for (int axis = 0; axis < 3; axis++){
-            Interval ax = get_interval(axis);
-            double d_inv = 1.0 / ray.direction_vector[axis];
+            if (centroid_bounds.max_point[axis] <= centroid_bounds.min_point[axis]){
+                continue;
+            }
 
-            double t0 = (ax.min - ray.starting_position[axis]) * d_inv;
-            double t1 = (ax.max - ray.starting_position[axis]) * d_inv;
+            // Sweeps from the right first, so the left sweep can evaluate every split in one pass.
+            double right_costs[number_of_bins];
+            AxisAlignedBox right_bounds = empty_box();
+            int right_count = 0;
+            for (int i = number_of_bins - 1; i > 0; i--){
+                grow_box(right_bounds, bins.bounds[axis][i]);
+                right_count += bins.counts[axis][i];
+                right_costs[i] = surface_area(right_bounds) * number_of_groups(right_count, group_size);
+            }
 
-            if (t0 < t1){
-                if (t0 > ray_interval.min){
-                    ray_interval.min = t0;
+            AxisAlignedBox left_bounds = empty_box();
+            int left_count = 0;
+            for (int i = 0; i < number_of_bins - 1; i++){
+                grow_box(left_bounds, bins.bounds[axis][i]);
+                left_count += bins.counts[axis][i];
+                if (left_count == 0 || left_count == number_of_node_primitives){
+                    continue;
                 }
-
-                if (t1 < ray_interval.max){
-                    ray_interval.max = t1;
+                double cost = constants::bvh_traversal_cost + (surface_area(left_bounds) * number_of_groups(left_count, group_size) + right_costs[i+1]) / node_area * constants::bvh_intersection_cost;
+                if (cost < best_split.cost){
+                    best_split.axis = axis;
+                    best_split.bin = i + 1;
+                    best_split.cost = cost;
                 }
             }
-            else{
-                if (t1 > ray_interval.min){
-                    ray_interval.min = t1;
-                }
+        }
+        return best_split;
+    }
 
-                if (t0 < ray_interval.max){
-                    ray_interval.max = t0;
-                }
+
+    bool use_parallel_pass(const int number_of_node_primitives){
+        return number_of_node_primitives >= 4 * constants::bvh_parallel_chunk_size && get_thread_pool().get_number_of_threads() > 1;
+    }
+
+
+    void compute_range_bounds(const std::vector<BuildPrimitive>& build_primitives, const int start, const int end, AxisAlignedBox& bounds, AxisAlignedBox& centroid_bounds){
+        // Minimum and maximum are exact, so combining per-chunk results gives the same bounds as a serial pass.
+        bounds = empty_box();
+        centroid_bounds = empty_box();
+        if (!use_parallel_pass(end - start)){
+            for (int i = start; i < end; i++){
+                grow_box(bounds, build_primitives[i].bounds);
+                grow_box(centroid_bounds, build_primitives[i].centroid);
             }
+            return;
+        }
 
-            if (ray_interval.max <= ray_interval.min){
-                return false;
+        int chunk_size = constants::bvh_parallel_chunk_size;
+        int number_of_chunks = (end - start + chunk_size - 1) / chunk_size;
+        std::vector<AxisAlignedBox> chunk_bounds(number_of_chunks, empty_box());
+        std::vector<AxisAlignedBox> chunk_centroid_bounds(number_of_chunks, empty_box());
+        get_thread_pool().parallel_for(end - start, chunk_size, [&](const int chunk, const int begin, const int stop){
+            for (int i = start + begin; i < start + stop; i++){
+                grow_box(chunk_bounds[chunk], build_primitives[i].bounds);
+                grow_box(chunk_centroid_bounds[chunk], build_primitives[i].centroid);
             }
+        });
+        for (int i = 0; i < number_of_chunks; i++){
+            grow_box(bounds, chunk_bounds[i]);
+            grow_box(centroid_bounds, chunk_centroid_bounds[i]);
         }
+    }
+
 
-        if (ray_interval.max < 0 || ray_interval.min == constants::max_ray_distance){
-            return false;
+    void compute_range_bins(const std::vector<BuildPrimitive>& build_primitives, const int start, const int end, const AxisAlignedBox& centroid_bounds, BinData& bins){
+        clear_bins(bins);
+        if (!use_parallel_pass(end - start)){
+            bin_primitives(build_primitives, start, end, centroid_bounds, bins);
+            return;
         }
 
-        distance = std::fmax(ray_interval.min, constants::EPSILON);
-        return true;
+        int chunk_size = constants::bvh_parallel_chunk_size;
+        int number_of_chunks = (end - start + chunk_size - 1) / chunk_size;
+        std::vector<BinData> chunk_bins(number_of_chunks);
+        get_thread_pool().parallel_for(end - start, chunk_size, [&](const int chunk, const int begin, const int stop){
+            clear_bins(chunk_bins[chunk]);
+            bin_primitives(build_primitives, start + begin, start + stop, centroid_bounds, chunk_bins[chunk]);
+        });
+        for (int i = 0; i < number_of_chunks; i++){
+            merge_bins(bins, chunk_bins[i]);
+        }
     }
 
 
-    void sort_by_axis(Object** triangles, int number_of_triangles, int axis){
-        std::sort(triangles, triangles + number_of_triangles, [axis](Object* obj1, Object* obj2){
-            return (obj1 -> compute_centroid())[axis] < (obj2 -> compute_centroid())[axis];
-            });
+    int partition_primitives(std::vector<BuildPrimitive>& build_primitives, const int start, const int end, const SplitCandidate& split, const AxisAlignedBox& centroid_bounds){
+        // The partition is stable, which makes its result unique, so the parallel version produces the same order as
+        // the serial one.
+        std::function<bool(const BuildPrimitive&)> goes_left = [&split, &centroid_bounds](const BuildPrimitive& primitive){
+            return compute_bin(primitive.centroid, centroid_bounds, split.axis) < split.bin;
+        };
+        if (!use_parallel_pass(end - start)){
+            return std::stable_partition(build_primitives.begin() + start, build_primitives.begin() + end, goes_left) - build_primitives.begin();
+        }
+
+        int chunk_size = constants::bvh_parallel_chunk_size;
+        int number_of_chunks = (end - start + chunk_size - 1) / chunk_size;
+        std::vector<char> is_left(end - start);
+        std::vector<int> left_counts(number_of_chunks, 0);
+        get_thread_pool().parallel_for(end - start, chunk_size, [&](const int chunk, const int begin, const int stop){
+            for (int i = begin; i < stop; i++){
+                is_left[i] = goes_left(build_primitives[start + i]);
+                left_counts[chunk] += is_left[i];
+            }
+        });
+
+        // Prefix sums give every chunk the position of its first primitive on either side of the split.
+        std::vector<int> left_offsets(number_of_chunks);
+        std::vector<int> right_offsets(number_of_chunks);
+        int total_left = 0;
+        for (int i = 0; i < number_of_chunks; i++){
+            left_offsets[i] = total_left;
+            total_left += left_counts[i];
+        }
+        int total_right = 0;
+        for (int i = 0; i < number_of_chunks; i++){
+            right_offsets[i] = total_left + total_right;
+            total_right += std::min(chunk_size, end - start - i * chunk_size) - left_counts[i];
+        }
+
+        std::vector<BuildPrimitive> partitioned(end - start);
+        get_thread_pool().parallel_for(end - start, chunk_size, [&](const int chunk, const int begin, const int stop){
+            int left = left_offsets[chunk];
+            int right = right_offsets[chunk];
+            for (int i = begin; i < stop; i++){
+                if (is_left[i]){
+                    partitioned[left++] = build_primitives[start + i];
+                }
+                else{
+                    partitioned[right++] = build_primitives[start + i];
+                }
+            }
+        });
+        get_thread_pool().parallel_for(end - start, chunk_size, [&](const int, const int begin, const int stop){
+            std::copy(partitioned.begin() + begin, partitioned.begin() + stop, build_primitives.begin() + start + begin);
+        });
+        return start + total_left;
+    }
+
+
+    void append_subtree(std::vector<LinearNode>& subtree_nodes, const std::vector<LinearNode>& child_nodes){
+        // Child indices are relative to the start of the array they were built in, so interior nodes are shifted.
+        int base = subtree_nodes.size();
+        for (size_t i = 0; i < child_nodes.size(); i++){
+            LinearNode node = child_nodes[i];
+            if (node.number_of_primitives == 0){
+                node.offset += base;
+            }
+            subtree_nodes.push_back(node);
+        }
     }
 
 
+    void build_subtree(std::vector<BuildPrimitive>& build_primitives, const int start, const int end, const int depth, const int group_size, std::vector<LinearNode>& subtree_nodes){
+        // Appends the subtree over [start, end) to subtree_nodes in depth-first order. Large subtrees build their first
+        // child as a separate task, into its own array, which is spliced in afterwards. This gives exactly the same
+        // nodes as building everything in a single array.
+        int node_index = subtree_nodes.size();
+        subtree_nodes.push_back(LinearNode());
 
-    Node::Node(Object** _triangles, int _number_of_triangles, int _leaf_size, int depth){
-        leaf_size = _leaf_size;
-        bounding_box = BoundingBox(_triangles, _number_of_triangles);
-        if (_number_of_triangles <= leaf_size){
-            triangles = _triangles;
-            number_of_triangles = _number_of_triangles;
-            is_leaf_node = true;
+        AxisAlignedBox bounds;
+        AxisAlignedBox centroid_bounds;
+        compute_range_bounds(build_primitives, start, end, bounds, centroid_bounds);
+        for (int i = 0; i < 3; i++){
+            subtree_nodes[node_index].bounds_min[i] = bounds.min_point[i] - constants::EPSILON;
+            subtree_nodes[node_index].bounds_max[i] = bounds.max_point[i] + constants::EPSILON;
+        }
+
+        // A leaf is made when splitting is not expected to be cheaper than intersecting every primitive, unless the
+        // leaf would become too large.
+        int number_of_node_primitives = end - start;
+        bool can_split = number_of_node_primitives > 1 && depth < max_depth;
+        SplitCandidate split;
+        if (can_split){
+            BinData bins;
+            compute_range_bins(build_primitives, start, end, centroid_bounds, bins);
+            split = find_best_split(bins, bounds, centroid_bounds, number_of_node_primitives, group_size);
+        }
+        double leaf_cost = number_of_groups(number_of_node_primitives, group_size) * constants::bvh_intersection_cost;
+        bool make_leaf = !can_split || (split.cost >= leaf_cost && number_of_node_primitives <= constants::bvh_max_leaf_size);
+        if (make_leaf){
+            subtree_nodes[node_index].offset = start;
+            subtree_nodes[node_index].number_of_primitives = number_of_node_primitives;
             return;
         }
-        is_leaf_node = false;
-        int axis = get_split_axis();
 
-        sort_by_axis(_triangles, _number_of_triangles, axis);
-        int split_index = _number_of_triangles / 2;
+        int split_index;
+        if (split.axis >= 0){
+            split_index = partition_primitives(build_primitives, start, end, split, centroid_bounds);
+        }
+        else{
+            // All centroids coincide, so the primitives can only be split by count.
+            split_index = start + number_of_node_primitives / 2;
+        }
 
-        Object** node1_triangles = new Object*[split_index];
-        Object** node2_triangles = new Object*[_number_of_triangles - split_index];
+        ThreadPool& thread_pool = get_thread_pool();
+        if (number_of_node_primitives >= constants::bvh_parallel_subtree_threshold && thread_pool.get_number_of_threads() > 1){
+            std::vector<LinearNode> first_child_nodes;
+            std::vector<LinearNode> second_child_nodes;
+            TaskGroup group;
+            thread_pool.run(group, [&build_primitives, start, split_index, depth, group_size, &first_child_nodes](){
+                build_subtree(build_primitives, start, split_index, depth+1, group_size, first_child_nodes);
+            });
+            build_subtree(build_primitives, split_index, end, depth+1, group_size, second_child_nodes);
+            thread_pool.wait(group);
 
-        for (int i = 0; i < split_index; i++){
-            node1_triangles[i] = _triangles[i];
+            append_subtree(subtree_nodes, first_child_nodes);
+            subtree_nodes[node_index].offset = subtree_nodes.size();
+            append_subtree(subtree_nodes, second_child_nodes);
         }
-        for (int i = split_index; i < _number_of_triangles; i++){
-            node2_triangles[i - split_index] = _triangles[i];
+        else{
+            build_subtree(build_primitives, start, split_index, depth+1, group_size, subtree_nodes);
+            subtree_nodes[node_index].offset = subtree_nodes.size();
+            build_subtree(build_primitives, split_index, end, depth+1, group_size, subtree_nodes);
         }
-
-        node1 = new Node(node1_triangles, split_index, _leaf_size, depth+1);
-        node2 = new Node(node2_triangles, _number_of_triangles - split_index, _leaf_size, depth+1);
+        subtree_nodes[node_index].number_of_primitives = 0;
     }
 
-    int Node::get_split_axis(){
-        int axis;
-        double max_length = 0;
-        for (int i = 0; i < 3; i++){
-            if (bounding_box.axis_length[i] >= max_length){
-                axis = i;
-                max_length = bounding_box.axis_length[i];
+
+    static_assert(constants::bvh_width == 4 || constants::bvh_width == 8, "The BVH width must be 4 or 8.");
+
+
+    std::vector<BuildPrimitive> compute_build_primitives(Object** objects, const int number_of_objects){
+        // Bounds and centroids are computed once up front, the build itself never calls back into the objects.
+        std::vector<BuildPrimitive> build_primitives(number_of_objects);
+        get_thread_pool().parallel_for(number_of_objects, constants::bvh_parallel_chunk_size, [objects, &build_primitives](const int, const int begin, const int end){
+            for (int i = begin; i < end; i++){
+                build_primitives[i].bounds.min_point = objects[i] -> min_axis_point();
+                build_primitives[i].bounds.max_point = objects[i] -> max_axis_point();
+                build_primitives[i].centroid = objects[i] -> compute_centroid();
+                build_primitives[i].index = i;
             }
+        });
+        return build_primitives;
+    }
+
+
+    template <class T>
+    BoundingVolumeHierarchy<T>::BoundingVolumeHierarchy(std::vector<BuildPrimitive>& build_primitives, const int _group_size){
+        group_size = _group_size;
+        int number_of_primitives = build_primitives.size();
+        if (number_of_primitives == 0){
+            return;
         }
-        return axis;
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+        nodes.reserve(2 * number_of_primitives);
+        build_subtree(build_primitives, 0, number_of_primitives, 0, group_size, nodes);
+        nodes.shrink_to_fit();
+
+        // The binary tree is only needed to find the wide nodes, so it is released once they are built.
+        sah_cost = compute_sah_cost();
+        int number_of_binary_nodes = nodes.size();
+        wide_nodes.reserve(number_of_binary_nodes / (constants::bvh_width - 1) + 1);
+        collapse_node(0);
+        wide_nodes.shrink_to_fit();
+        std::vector<LinearNode>().swap(nodes);
+
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        std::clog << "Built BVH over " << number_of_primitives << " primitives in " << std::chrono::duration<double>(end - begin).count() << "[s]: "
+                  << number_of_binary_nodes << " binary nodes collapsed into " << wide_nodes.size() << " " << constants::bvh_width << "-wide nodes, SAH cost "
+                  << sah_cost << ".\n";
     }
 
-    bool Node::intersect(Ray& ray, Hit& hit){
-        if (is_leaf_node){
-            if (number_of_triangles == 0){
-                return false;
+    template <class T>
+    int BoundingVolumeHierarchy<T>::collapse_node(const int node_index){
+        // Gathers up to bvh_width descendants of a binary node by repeatedly opening the interior child with the largest
+        // surface area, which is the child most likely to be hit.
+        int wide_index = wide_nodes.size();
+        wide_nodes.push_back(WideNode<T>());
+
+        int children[constants::bvh_width];
+        int number_of_children = 0;
+        if (nodes[node_index].number_of_primitives > 0){
+            children[number_of_children++] = node_index;
+        }
+        else{
+            children[number_of_children++] = node_index + 1;
+            children[number_of_children++] = nodes[node_index].offset;
+        }
+
+        while (number_of_children < constants::bvh_width){
+            int largest_child = -1;
+            double largest_area = -1;
+            for (int i = 0; i < number_of_children; i++){
+                const LinearNode& child = nodes[children[i]];
+                if (child.number_of_primitives > 0){
+                    continue;
+                }
+                AxisAlignedBox child_bounds;
+                child_bounds.min_point = vec3(child.bounds_min[0], child.bounds_min[1], child.bounds_min[2]);
+                child_bounds.max_point = vec3(child.bounds_max[0], child.bounds_max[1], child.bounds_max[2]);
+                double area = surface_area(child_bounds);
+                if (area > largest_area){
+                    largest_child = i;
+                    largest_area = area;
+                }
             }
-            Hit triangle_hit;
-            bool hits_triangles = find_closest_hit(triangle_hit, ray, triangles, number_of_triangles);
-            if (hits_triangles && triangle_hit.distance < hit.distance && triangle_hit.distance > constants::EPSILON){
-                hit.distance = triangle_hit.distance;
-                hit.primitive_ID = triangle_hit.primitive_ID;
-                return true;
+            if (largest_child < 0){
+                break;
             }
-            return false;
+            int opened_node = children[largest_child];
+            children[largest_child] = opened_node + 1;
+            children[number_of_children++] = nodes[opened_node].offset;
         }
 
-        double d1;
-        bool bvh1_hit = node1 -> bounding_box.intersect(ray, d1);
+        // Unused slots get inverted boxes, which no ray can hit, so the box test needs no mask.
+        WideNode<T>& wide_node = wide_nodes[wide_index];
+        wide_node.number_of_children = number_of_children;
+        for (int i = 0; i < constants::bvh_width; i++){
+            for (int axis = 0; axis < 3; axis++){
+                wide_node.bounds[axis][i] = round_down<T>(i < number_of_children ? nodes[children[i]].bounds_min[axis] : constants::max_ray_distance);
+                wide_node.bounds[axis + 3][i] = round_up<T>(i < number_of_children ? nodes[children[i]].bounds_max[axis] : -constants::max_ray_distance);
+            }
+            wide_node.children[i] = i < number_of_children ? nodes[children[i]].offset : 0;
+            wide_node.counts[i] = i < number_of_children ? nodes[children[i]].number_of_primitives : 0;
+        }
 
-        double d2;
-        bool bvh2_hit = node2 -> bounding_box.intersect(ray, d2);
+        // The recursion may reallocate wide_nodes, so the node is accessed through its index from here on.
+        for (int i = 0; i < number_of_children; i++){
+            if (nodes[children[i]].number_of_primitives == 0){
+                int child_index = collapse_node(children[i]);
+                wide_nodes[wide_index].children[i] = child_index;
+            }
+        }
+        return wide_index;
+    }
 
-        if (bvh1_hit && bvh2_hit){
-            if (d1 > d2){
-                bool node1_success = node1 -> intersect(ray, hit);
-                bool node2_success;
-                if (d2 < hit.distance || hit.distance == -1){
-                    node2_success = node2 -> intersect(ray, hit);
-                }
-                return node1_success || node2_success;
+    template <class T>
+    double BoundingVolumeHierarchy<T>::compute_sah_cost() const{
+        // Expected cost of a random ray hitting the root box, relative to the cost of a single intersection test.
+        if (nodes.empty()){
+            return 0;
+        }
+        AxisAlignedBox root_bounds;
+        root_bounds.min_point = vec3(nodes[0].bounds_min[0], nodes[0].bounds_min[1], nodes[0].bounds_min[2]);
+        root_bounds.max_point = vec3(nodes[0].bounds_max[0], nodes[0].bounds_max[1], nodes[0].bounds_max[2]);
+        double root_area = surface_area(root_bounds);
+
+        double cost = 0;
+        for (size_t i = 0; i < nodes.size(); i++){
+            AxisAlignedBox node_bounds;
+            node_bounds.min_point = vec3(nodes[i].bounds_min[0], nodes[i].bounds_min[1], nodes[i].bounds_min[2]);
+            node_bounds.max_point = vec3(nodes[i].bounds_max[0], nodes[i].bounds_max[1], nodes[i].bounds_max[2]);
+            double relative_area = surface_area(node_bounds) / root_area;
+            if (nodes[i].number_of_primitives > 0){
+                cost += relative_area * number_of_groups(nodes[i].number_of_primitives, group_size) * constants::bvh_intersection_cost;
             }
             else{
-                bool node1_success;
-                bool node2_success = node2 -> intersect(ray, hit);
-                if (d1 < hit.distance || hit.distance == -1){
-                    node1_success = node1 -> intersect(ray, hit);
-                }
-                return node1_success || node2_success;
+                cost += relative_area * constants::bvh_traversal_cost;
             }
-
         }
-        else if (bvh1_hit){
-            return node1 -> intersect(ray, hit);
+        return cost;
+    }
+
+    template <class T>
+    void BoundingVolumeHierarchy<T>::get_leaves(std::vector<int>& leaf_starts, std::vector<int>& leaf_counts) const{
+        // Every leaf is a child slot of exactly one wide node.
+        leaf_starts.clear();
+        leaf_counts.clear();
+        for (size_t i = 0; i < wide_nodes.size(); i++){
+            for (int j = 0; j < wide_nodes[i].number_of_children; j++){
+                if (wide_nodes[i].counts[j] > 0){
+                    leaf_starts.push_back(wide_nodes[i].children[j]);
+                    leaf_counts.push_back(wide_nodes[i].counts[j]);
+                }
+            }
         }
+    }
 
-        else if (bvh2_hit){
-            return node2 -> intersect(ray, hit);
+    template <class T>
+    void BoundingVolumeHierarchy<T>::set_leaf_starts(const std::vector<int>& leaf_starts){
+        // Visits the leaves in the same order as get_leaves.
+        int leaf = 0;
+        for (size_t i = 0; i < wide_nodes.size(); i++){
+            for (int j = 0; j < wide_nodes[i].number_of_children; j++){
+                if (wide_nodes[i].counts[j] > 0){
+                    wide_nodes[i].children[j] = leaf_starts[leaf++];
+                }
+            }
         }
-        return false;
     }
 
+    template <class T>
+    int BoundingVolumeHierarchy<T>::get_number_of_nodes() const { return wide_nodes.size(); }
+    template <class T>
+    double BoundingVolumeHierarchy<T>::get_sah_cost() const { return sah_cost; }
+
+    template <class T>
+    void BoundingVolumeHierarchy<T>::write_cache(CacheWriter& writer) const{
+        // The binary tree is released after the build, so only the wide nodes are stored.
+        writer.write_vector(wide_nodes);
+        writer.write(sah_cost);
+        writer.write(group_size);
+    }
+
+    template <class T>
+    bool BoundingVolumeHierarchy<T>::has_valid_structure() const{
+        // For a BVH read back from a cache. Interior children have to come after their parent, which rules out cycles,
+        // and the tree must not be deeper than the traversal stack allows. The leaf ranges are left to the owner, which
+        // knows what they refer to.
+        std::vector<int> depths(wide_nodes.size(), 0);
+        for (size_t i = 0; i < wide_nodes.size(); i++){
+            const WideNode<T>& node = wide_nodes[i];
+            if (node.number_of_children < 0 || node.number_of_children > constants::bvh_width){
+                return false;
+            }
+            for (int j = 0; j < node.number_of_children; j++){
+                if (node.counts[j] < 0){
+                    return false;
+                }
+                if (node.counts[j] == 0){
+                    int child = node.children[j];
+                    if (child <= int(i) || child >= int(wide_nodes.size())){
+                        return false;
+                    }
+                    depths[child] = std::max(depths[child], depths[i] + 1);
+                    if (depths[child] >= max_depth){
+                        return false;
+                    }
+                }
+            }
+        }
+        return group_size > 0;
+    }
 
-    BoundingVolumeHierarchy::BoundingVolumeHierarchy(Object** triangles, int number_of_triangles, int leaf_size){
-        root_node = new Node(triangles, number_of_triangles, leaf_size);
+    template <class T>
+    void BoundingVolumeHierarchy<T>::read_cache(CacheReader& reader){
+        reader.read_vector(wide_nodes);
+        reader.read(sah_cost);
+        reader.read(group_size);
     }
 
-    bool BoundingVolumeHierarchy::intersect(Hit& hit, Ray& ray) const{
-        double distance_to_bounding_box;
-        if (!root_node -> bounding_box.intersect(ray, distance_to_bounding_box)){
-            return false;
+    template class BoundingVolumeHierarchy<double>;
+    template class BoundingVolumeHierarchy<float>;
+
+    int intersect_children(const WideNode<double>& node, const BoxRay<double>& box_ray, const double t_max, const int* near_planes, const int* far_planes, double* distances){
+        // Slab test of all children at once. The planes are picked by the sign of the direction, so the entry and exit
+        // distances need no sorting. A NaN, from a ray inside a slab plane with a zero direction component, is never
+        // chosen by the max and min below and thereby ignores that axis. Returns a bit mask of the children hit.
+        int hit_mask = 0;
+#if defined(__AVX__)
+        for (int lane = 0; lane < constants::bvh_width; lane += 4){
+            __m256d t_near = _mm256_setzero_pd();
+            __m256d t_far = _mm256_set1_pd(t_max);
+            for (int axis = 0; axis < 3; axis++){
+                __m256d origin = _mm256_set1_pd(box_ray.origin[axis]);
+                __m256d inverse_direction = _mm256_set1_pd(box_ray.inverse_direction[axis]);
+                __m256d t0 = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(&node.bounds[near_planes[axis]][lane]), origin), inverse_direction);
+                __m256d t1 = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(&node.bounds[far_planes[axis]][lane]), origin), inverse_direction);
+                t_near = _mm256_max_pd(t0, t_near);
+                t_far = _mm256_min_pd(t1, t_far);
+            }
+            hit_mask |= _mm256_movemask_pd(_mm256_cmp_pd(t_near, t_far, _CMP_LE_OQ)) << lane;
+            _mm256_storeu_pd(distances + lane, t_near);
         }
+#elif defined(__SSE2__)
+        for (int lane = 0; lane < constants::bvh_width; lane += 2){
+            __m128d t_near = _mm_setzero_pd();
+            __m128d t_far = _mm_set1_pd(t_max);
+            for (int axis = 0; axis < 3; axis++){
+                __m128d origin = _mm_set1_pd(box_ray.origin[axis]);
+                __m128d inverse_direction = _mm_set1_pd(box_ray.inverse_direction[axis]);
+                __m128d t0 = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(&node.bounds[near_planes[axis]][lane]), origin), inverse_direction);
+                __m128d t1 = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(&node.bounds[far_planes[axis]][lane]), origin), inverse_direction);
+                t_near = _mm_max_pd(t0, t_near);
+                t_far = _mm_min_pd(t1, t_far);
+            }
+            hit_mask |= _mm_movemask_pd(_mm_cmple_pd(t_near, t_far)) << lane;
+            _mm_storeu_pd(distances + lane, t_near);
+        }
+#else
+        for (int lane = 0; lane < constants::bvh_width; lane++){
+            double t_near = 0;
+            double t_far = t_max;
+            for (int axis = 0; axis < 3; axis++){
+                double t0 = (node.bounds[near_planes[axis]][lane] - box_ray.origin[axis]) * box_ray.inverse_direction[axis];
+                double t1 = (node.bounds[far_planes[axis]][lane] - box_ray.origin[axis]) * box_ray.inverse_direction[axis];
+                t_near = t0 > t_near ? t0 : t_near;
+                t_far = t1 < t_far ? t1 : t_far;
+            }
+            if (t_near <= t_far){
+                hit_mask |= 1 << lane;
+            }
+            distances[lane] = t_near;
+        }
+#endif
+        return hit_mask;
+    }
 
-        return root_node -> intersect(ray, hit);;
+
+    int intersect_children(const WideNode<float>& node, const BoxRay<float>& box_ray, const double t_max, const int* near_planes, const int* far_planes, float* distances){
+        // The same slab test in single precision, twice as many children per instruction. Entry distances are lowered
+        // and exit distances raised by the rounding errors bounded in box_ray, so a box is never missed, only sometimes
+        // visited when it is just missed.
+        int hit_mask = 0;
+        float far_limit = round_up<float>(t_max);
+#if defined(__AVX__)
+        if (constants::bvh_width % 8 == 0){
+            for (int lane = 0; lane < constants::bvh_width; lane += 8){
+                __m256 t_near = _mm256_setzero_ps();
+                __m256 t_far = _mm256_set1_ps(far_limit);
+                for (int axis = 0; axis < 3; axis++){
+                    __m256 origin = _mm256_set1_ps(box_ray.origin[axis]);
+                    __m256 inverse_direction = _mm256_set1_ps(box_ray.inverse_direction[axis]);
+                    __m256 distance_error = _mm256_set1_ps(box_ray.distance_error[axis]);
+                    __m256 t0 = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&node.bounds[near_planes[axis]][lane]), origin), inverse_direction), distance_error);
+                    __m256 t1 = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&node.bounds[far_planes[axis]][lane]), origin), inverse_direction), distance_error);
+                    t_near = _mm256_max_ps(t0, t_near);
+                    t_far = _mm256_min_ps(_mm256_mul_ps(t1, _mm256_set1_ps(box_ray.far_scale)), t_far);
+                }
+                hit_mask |= _mm256_movemask_ps(_mm256_cmp_ps(t_near, t_far, _CMP_LE_OQ)) << lane;
+                _mm256_storeu_ps(distances + lane, t_near);
+            }
+            return hit_mask;
+        }
+#endif
+#if defined(__SSE2__)
+        for (int lane = 0; lane < constants::bvh_width; lane += 4){
+            __m128 t_near = _mm_setzero_ps();
+            __m128 t_far = _mm_set1_ps(far_limit);
+            for (int axis = 0; axis < 3; axis++){
+                __m128 origin = _mm_set1_ps(box_ray.origin[axis]);
+                __m128 inverse_direction = _mm_set1_ps(box_ray.inverse_direction[axis]);
+                __m128 distance_error = _mm_set1_ps(box_ray.distance_error[axis]);
+                __m128 t0 = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.bounds[near_planes[axis]][lane]), origin), inverse_direction), distance_error);
+                __m128 t1 = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.bounds[far_planes[axis]][lane]), origin), inverse_direction), distance_error);
+                t_near = _mm_max_ps(t0, t_near);
+                t_far = _mm_min_ps(_mm_mul_ps(t1, _mm_set1_ps(box_ray.far_scale)), t_far);
+            }
+            hit_mask |= _mm_movemask_ps(_mm_cmple_ps(t_near, t_far)) << lane;
+            _mm_storeu_ps(distances + lane, t_near);
+        }
+#else
+        for (int lane = 0; lane < constants::bvh_width; lane++){
+            float t_near = 0;
+            float t_far = far_limit;
+            for (int axis = 0; axis < 3; axis++){
+                float t0 = (node.bounds[near_planes[axis]][lane] - box_ray.origin[axis]) * box_ray.inverse_direction[axis] - box_ray.distance_error[axis];
+                float t1 = ((node.bounds[far_planes[axis]][lane] - box_ray.origin[axis]) * box_ray.inverse_direction[axis] + box_ray.distance_error[axis]) * box_ray.far_scale;
+                t_near = t0 > t_near ? t0 : t_near;
+                t_far = t1 < t_far ? t1 : t_far;
+            }
+            if (t_near <= t_far){
+                hit_mask |= 1 << lane;
+            }
+            distances[lane] = t_near;
+        }
+#endif
+        return hit_mask;
     }
 }
@@ -2,83 +2,295 @@
 #define BVH_H
 
 #include "objects.h"
+#include "threadpool.h"
+#include "scenecache.h"
+#include <vector>
 #include <chrono>
+#include <limits>
 
 namespace BVH{
-    vec3 get_max_point(Object** triangles, int number_of_triangles);
-    vec3 get_min_point(Object** triangles, int number_of_triangles);
+    const int max_depth = 64;
 
 
-    struct Interval{
-        double min;
-        double max;
-
-        Interval(){}
-        Interval(const double min, const double max) : min(min), max(max) {}
+    struct AxisAlignedBox{
+        vec3 min_point;
+        vec3 max_point;
     };
 
 
-    class BoundingBox{
-        public:
-            double axis_length[3];
+    AxisAlignedBox empty_box();
+    void grow_box(AxisAlignedBox& box, const AxisAlignedBox& other);
+    void grow_box(AxisAlignedBox& box, const vec3& point);
+    double surface_area(const AxisAlignedBox& box);
 
-            BoundingBox(){}
-            BoundingBox(Object** _triangles, int number_of_triangles);
 
-            inline bool is_within_bounds(const double x, const double lower, const double higher) const{
-                return lower <= x && x <= higher;
-            }
+    struct LinearNode{
+        // Nodes are stored in depth-first order, so the first child of an interior node always follows it directly and
+        // only the index of the second child is stored. Leaves instead store a range in the reordered primitive array.
+        double bounds_min[3];
+        double bounds_max[3];
+        int offset; // First primitive for leaves, second child for interior nodes.
+        int number_of_primitives; // Zero for interior nodes.
+    };
 
-            Interval get_interval(const int axis) const;
-            bool intersect(Ray& ray, double& distance) const;
 
-        private:
-            vec3 p1;
-            vec3 p2;
-            Interval x_interval;
-            Interval y_interval;
-            Interval z_interval;
-            double width;
-            double height;
-            double length;
+    template <class T>
+    struct WideNode{
+        // Made by collapsing the binary tree. The child boxes are stored in structure-of-arrays form, first the three
+        // minimum and then the three maximum coordinates, so one slab can be tested against all children at once.
+        // Leaves are not stored as nodes, a child slot refers to the primitive range directly. In single precision the
+        // boxes are rounded outwards, so they still contain their primitives.
+        T bounds[6][constants::bvh_width];
+        int children[constants::bvh_width]; // Wide node index, or first primitive for leaves.
+        int counts[constants::bvh_width]; // Number of primitives for leaves, zero for interior children.
+        int number_of_children;
     };
 
 
-    void sort_by_axis(Object** triangles, int number_of_triangles, int axis);
+    template <class T>
+    struct BoxRay{
+        // The ray in the precision of the boxes. distance_error bounds how much rounding the origin to T moves the slab
+        // distances along each axis, and far_scale widens the exit distances by the rounding error of the slab test, so
+        // that the test in single precision never misses a box the ray hits.
+        T origin[3];
+        T inverse_direction[3];
+        T distance_error[3];
+        T far_scale;
+    };
 
 
-    class Node{
-        public:
-            BoundingBox bounding_box;
+    template <class T>
+    inline T round_down(const double value){
+        T rounded = T(value);
+        return rounded > value ? std::nextafter(rounded, -std::numeric_limits<T>::infinity()) : rounded;
+    }
 
-            Node(){}
-            Node(Object** _triangles, int _number_of_triangles, int _leaf_size=12, int depth=0);
 
-            int get_split_axis();
-            bool intersect(Ray& ray, Hit& hit);
+    template <class T>
+    inline T round_up(const double value){
+        T rounded = T(value);
+        return rounded < value ? std::nextafter(rounded, std::numeric_limits<T>::infinity()) : rounded;
+    }
 
 
-        private:
-            int leaf_size;
-            bool is_leaf_node;
-            Node* node1;
-            Node* node2;
-            int depth;
-            Object** triangles;
-            int number_of_triangles;
+    template <class T>
+    BoxRay<T> prepare_box_ray(const Ray& ray){
+        const T unit_roundoff = std::numeric_limits<T>::epsilon() / 2;
+        const T gamma_3 = 3 * unit_roundoff / (1 - 3 * unit_roundoff);
+        BoxRay<T> box_ray;
+        for (int axis = 0; axis < 3; axis++){
+            box_ray.origin[axis] = T(ray.starting_position[axis]);
+            box_ray.inverse_direction[axis] = T(ray.inverse_direction[axis]);
+            double origin_error = std::abs(ray.starting_position[axis] - double(box_ray.origin[axis]));
+            box_ray.distance_error[axis] = std::isinf(ray.inverse_direction[axis]) ? 0 : round_up<T>(origin_error * std::abs(ray.inverse_direction[axis]));
+        }
+        box_ray.far_scale = 1 + 2 * gamma_3;
+        return box_ray;
+    }
+
+
+    struct BuildPrimitive{
+        AxisAlignedBox bounds;
+        vec3 centroid;
+        int index;
+    };
+
+
+    struct SplitCandidate{
+        int axis = -1;
+        int bin = 0;
+        double cost = constants::max_ray_distance;
+    };
+
+
+    struct BinData{
+        int counts[3][constants::bvh_number_of_bins];
+        AxisAlignedBox bounds[3][constants::bvh_number_of_bins];
     };
 
 
+    int compute_bin(const vec3& centroid, const AxisAlignedBox& centroid_bounds, const int axis);
+    void clear_bins(BinData& bins);
+    void merge_bins(BinData& bins, const BinData& other);
+    void bin_primitives(const std::vector<BuildPrimitive>& build_primitives, const int start, const int end, const AxisAlignedBox& centroid_bounds, BinData& bins);
+    int number_of_groups(const int number_of_primitives, const int group_size);
+    SplitCandidate find_best_split(const BinData& bins, const AxisAlignedBox& bounds, const AxisAlignedBox& centroid_bounds, const int number_of_node_primitives, const int group_size);
+
+    void compute_range_bounds(const std::vector<BuildPrimitive>& build_primitives, const int start, const int end, AxisAlignedBox& bounds, AxisAlignedBox& centroid_bounds);
+    void compute_range_bins(const std::vector<BuildPrimitive>& build_primitives, const int start, const int end, const AxisAlignedBox& centroid_bounds, BinData& bins);
+    int partition_primitives(std::vector<BuildPrimitive>& build_primitives, const int start, const int end, const SplitCandidate& split, const AxisAlignedBox& centroid_bounds);
+    void build_subtree(std::vector<BuildPrimitive>& build_primitives, const int start, const int end, const int depth, const int group_size, std::vector<LinearNode>& subtree_nodes);
+    std::vector<BuildPrimitive> compute_build_primitives(Object** objects, const int number_of_objects);
+
+
+    int intersect_children(const WideNode<double>& node, const BoxRay<double>& box_ray, const double t_max, const int* near_planes, const int* far_planes, double* distances);
+    int intersect_children(const WideNode<float>& node, const BoxRay<float>& box_ray, const double t_max, const int* near_planes, const int* far_planes, float* distances);
+
+
+    template <class T>
     class BoundingVolumeHierarchy{
+        // Built over the bounds of any kind of primitive. The build reorders build_primitives so that every leaf refers
+        // to a contiguous range of it, and the index field of each entry then tells which primitive is in that slot.
+        // Traversal calls intersect_primitive(slot, ray) for the slots of every leaf it visits. The callback returns
+        // true on a closer hit, and is then expected to shorten ray.t_max. intersect_leaves instead hands over the whole
+        // range of a leaf, for primitives that are tested in groups. The build then counts the cost of a leaf per
+        // group_size primitives, so leaves fill whole groups. The boxes are stored and tested in T.
+        // occluded and occluded_leaves are the any-hit versions for shadow rays. Their callbacks return true on a hit that
+        // blocks the ray, which ends the traversal.
+        // set_leaf_starts replaces where each leaf starts, for primitives that are stored per leaf in some other array,
+        // and the leaf callbacks then get the new start.
         public:
             BoundingVolumeHierarchy(){}
-            BoundingVolumeHierarchy(Object** triangles, int number_of_triangles, int leaf_size);
+            BoundingVolumeHierarchy(std::vector<BuildPrimitive>& build_primitives, const int _group_size=1);
 
-            bool intersect(Hit& hit, Ray& ray) const;
+            template <class PrimitiveIntersector>
+            bool intersect(Ray& ray, const PrimitiveIntersector& intersect_primitive) const;
+            template <class LeafIntersector>
+            bool intersect_leaves(Ray& ray, const LeafIntersector& intersect_leaf) const;
+            template <class PrimitiveIntersector>
+            bool occluded(Ray& ray, const PrimitiveIntersector& intersect_primitive) const;
+            template <class LeafIntersector>
+            bool occluded_leaves(Ray& ray, const LeafIntersector& intersect_leaf) const;
+            void get_leaves(std::vector<int>& leaf_starts, std::vector<int>& leaf_counts) const;
+            void set_leaf_starts(const std::vector<int>& leaf_starts);
+            int get_number_of_nodes() const;
+            double get_sah_cost() const;
+            void write_cache(CacheWriter& writer) const;
+            void read_cache(CacheReader& reader);
+            bool has_valid_structure() const;
 
         private:
-            Node* root_node;
+            std::vector<LinearNode> nodes;
+            std::vector<WideNode<T>> wide_nodes;
+            double sah_cost = 0;
+            int group_size = 1;
+
+            double compute_sah_cost() const;
+            int collapse_node(const int node_index);
+            template <bool stop_at_first_hit, class LeafIntersector>
+            bool traverse(Ray& ray, const LeafIntersector& intersect_leaf) const;
     };
+
+
+    template <class T>
+    template <class PrimitiveIntersector>
+    bool BoundingVolumeHierarchy<T>::intersect(Ray& ray, const PrimitiveIntersector& intersect_primitive) const{
+        return intersect_leaves(ray, [&intersect_primitive](const int start, const int count, Ray& ray){
+            bool found_a_hit = false;
+            for (int i = start; i < start + count; i++){
+                if (intersect_primitive(i, ray)){
+                    found_a_hit = true;
+                }
+            }
+            return found_a_hit;
+        });
+    }
+
+
+    template <class T>
+    template <class LeafIntersector>
+    bool BoundingVolumeHierarchy<T>::intersect_leaves(Ray& ray, const LeafIntersector& intersect_leaf) const{
+        return traverse<false>(ray, intersect_leaf);
+    }
+
+
+    template <class T>
+    template <class PrimitiveIntersector>
+    bool BoundingVolumeHierarchy<T>::occluded(Ray& ray, const PrimitiveIntersector& intersect_primitive) const{
+        return occluded_leaves(ray, [&intersect_primitive](const int start, const int count, Ray& ray){
+            for (int i = start; i < start + count; i++){
+                if (intersect_primitive(i, ray)){
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+
+
+    template <class T>
+    template <class LeafIntersector>
+    bool BoundingVolumeHierarchy<T>::occluded_leaves(Ray& ray, const LeafIntersector& intersect_leaf) const{
+        return traverse<true>(ray, intersect_leaf);
+    }
+
+
+    template <class T>
+    template <bool stop_at_first_hit, class LeafIntersector>
+    bool BoundingVolumeHierarchy<T>::traverse(Ray& ray, const LeafIntersector& intersect_leaf) const{
+        if (wide_nodes.empty()){
+            return false;
+        }
+
+        BoxRay<T> box_ray = prepare_box_ray<T>(ray);
+        int near_planes[3];
+        int far_planes[3];
+        for (int axis = 0; axis < 3; axis++){
+            bool negative_direction = ray.inverse_direction[axis] < 0;
+            near_planes[axis] = negative_direction ? axis + 3 : axis;
+            far_planes[axis] = negative_direction ? axis : axis + 3;
+        }
+
+        // Stack entries are wide nodes (count zero) or leaves, together with the distance to their box so they can be
+        // skipped once a closer hit is found.
+        const int max_stack_size = max_depth * (constants::bvh_width - 1) + 1;
+        int index_stack[max_stack_size];
+        int count_stack[max_stack_size];
+        double distance_stack[max_stack_size];
+        int stack_size = 0;
+        index_stack[stack_size] = 0;
+        count_stack[stack_size] = 0;
+        distance_stack[stack_size] = 0;
+        stack_size++;
+
+        bool found_a_hit = false;
+        while (stack_size > 0){
+            stack_size--;
+            if (distance_stack[stack_size] > ray.t_max){
+                continue;
+            }
+            int index = index_stack[stack_size];
+            int count = count_stack[stack_size];
+
+            if (count > 0){
+                if (intersect_leaf(index, count, ray)){
+                    found_a_hit = true;
+                    if (stop_at_first_hit){
+                        return true;
+                    }
+                }
+                continue;
+            }
+
+            const WideNode<T>& node = wide_nodes[index];
+            T distances[constants::bvh_width];
+            int hit_mask = intersect_children(node, box_ray, ray.t_max, near_planes, far_planes, distances);
+
+            // Sorts the children that were hit by distance, then pushes them farthest first so the nearest is visited next.
+            int order[constants::bvh_width];
+            int number_of_hits = 0;
+            for (int i = 0; i < node.number_of_children; i++){
+                if (!(hit_mask & (1 << i))){
+                    continue;
+                }
+                int j = number_of_hits;
+                while (j > 0 && distances[order[j-1]] < distances[i]){
+                    order[j] = order[j-1];
+                    j--;
+                }
+                order[j] = i;
+                number_of_hits++;
+            }
+            for (int i = 0; i < number_of_hits; i++){
+                int child = order[i];
+                index_stack[stack_size] = node.children[child];
+                count_stack[stack_size] = node.counts[child];
+                distance_stack[stack_size] = distances[child];
+                stack_size++;
+            }
+        }
+        return found_a_hit;
+    }
 }
 
 #endif
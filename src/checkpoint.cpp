@@ -0,0 +1,123 @@
+#include "checkpoint.h"
+#include "scenecache.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+
+uint64_t hash_render_settings(){
+    uint64_t hash = hash_value(0, constants::samples_per_pass);
+    hash = hash_value(hash, constants::max_recursion_depth);
+    hash = hash_value(hash, constants::force_tracing_limit);
+    hash = hash_value(hash, constants::enable_next_event_estimation);
+    hash = hash_value(hash, constants::enable_anti_aliasing);
+    hash = hash_value(hash, constants::enable_environment_map);
+    hash = hash_value(hash, constants::environment_map_intensity);
+    hash = hash_value(hash, constants::adaptive_min_samples);
+    hash = hash_value(hash, constants::adaptive_max_samples);
+    hash = hash_value(hash, constants::adaptive_samples_per_round);
+    hash = hash_value(hash, constants::adaptive_error_threshold);
+    hash = hash_value(hash, constants::target_samples_per_pixel);
+    return hash;
+}
+
+
+uint64_t hash_scene(const Scene& scene){
+    // A fingerprint of the camera and of the shape, size and emission of every object. It does not see every detail of
+    // a scene, but it does catch a checkpoint being resumed with a different or rearranged one.
+    uint64_t hash = hash_value(0, scene.number_of_objects);
+    hash = hash_value(hash, scene.camera -> position);
+    hash = hash_value(hash, scene.camera -> get_starting_directions(0, 0));
+    hash = hash_value(hash, scene.camera -> get_starting_directions(constants::WIDTH, constants::HEIGHT));
+    hash = hash_value(hash, scene.environment != nullptr);
+    for (int i = 0; i < scene.number_of_objects; i++){
+        const Object* object = scene.objects[i];
+        hash = hash_value(hash, int(object -> get_primitive_type()));
+        hash = hash_value(hash, object -> area);
+        hash = hash_value(hash, object -> light_power());
+        if (object -> is_bounded()){
+            hash = hash_value(hash, object -> min_axis_point());
+            hash = hash_value(hash, object -> max_axis_point());
+        }
+    }
+    return hash;
+}
+
+
+bool save_checkpoint(const char* file_name, const RenderState& state, const PixelAccumulator* accumulators){
+    // Writes to a temporary file first and renames it, so a process killed mid-write leaves the previous checkpoint intact.
+    std::string temporary_file_name = std::string(file_name) + ".tmp";
+    FILE* checkpoint_file = fopen(temporary_file_name.c_str(), "wb");
+    if (!checkpoint_file){
+        perror("Error opening checkpoint file.");
+        return false;
+    }
+
+    CheckpointHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+    header.version = checkpoint_version;
+    header.record_size = sizeof(PixelAccumulator);
+    header.width = constants::WIDTH;
+    header.height = constants::HEIGHT;
+    header.random_seed = constants::random_seed;
+    header.samples_per_pixel = constants::samples_per_pixel;
+    header.mode = state.mode;
+    header.pass = state.pass;
+    header.remaining_samples = state.remaining_samples;
+    header.settings_hash = hash_render_settings();
+    header.scene_hash = state.scene_hash;
+
+    size_t number_of_pixels = constants::WIDTH * constants::HEIGHT;
+    bool success = fwrite(&header, sizeof(header), 1, checkpoint_file) == 1;
+    success = success && fwrite(accumulators, sizeof(PixelAccumulator), number_of_pixels, checkpoint_file) == number_of_pixels;
+    success = fclose(checkpoint_file) == 0 && success;
+    if (!success || std::rename(temporary_file_name.c_str(), file_name) != 0){
+        perror("Error writing checkpoint file.");
+        return false;
+    }
+    return true;
+}
+
+
+bool load_checkpoint(const char* file_name, RenderState& state, PixelAccumulator* accumulators){
+    FILE* checkpoint_file = fopen(file_name, "rb");
+    if (!checkpoint_file){
+        return false;
+    }
+
+    CheckpointHeader header;
+    if (fread(&header, sizeof(header), 1, checkpoint_file) != 1){
+        fclose(checkpoint_file);
+        return false;
+    }
+
+    bool compatible = std::memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) == 0
+                   && header.version == checkpoint_version
+                   && header.record_size == sizeof(PixelAccumulator)
+                   && header.width == constants::WIDTH
+                   && header.height == constants::HEIGHT
+                   && header.random_seed == constants::random_seed
+                   && header.samples_per_pixel == constants::samples_per_pixel
+                   && header.mode == state.mode
+                   && header.settings_hash == hash_render_settings()
+                   && header.scene_hash == state.scene_hash;
+    if (!compatible){
+        std::clog << "Checkpoint " << file_name << " does not match the current render settings.\n";
+        fclose(checkpoint_file);
+        return false;
+    }
+
+    size_t number_of_pixels = constants::WIDTH * constants::HEIGHT;
+    bool success = fread(accumulators, sizeof(PixelAccumulator), number_of_pixels, checkpoint_file) == number_of_pixels;
+    fclose(checkpoint_file);
+    if (!success){
+        std::clog << "Checkpoint " << file_name << " is truncated.\n";
+        return false;
+    }
+
+    state.pass = header.pass;
+    state.remaining_samples = header.remaining_samples;
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include "constants.h"
+#include "accumulator.h"
+#include "scene.h"
+
+
+enum render_mode{
+    FIXED_RENDERING = 0,
+    ADAPTIVE_RENDERING = 1,
+    PROGRESSIVE_RENDERING = 2
+};
+
+
+struct RenderState{
+    // Everything besides the pixel accumulators that is needed to continue a render where it stopped.
+    int mode = FIXED_RENDERING;
+    int pass = 0;
+    long long remaining_samples = 0;
+    uint64_t scene_hash = 0;
+};
+
+
+struct CheckpointHeader{
+    // settings_hash covers the settings the accumulated samples depend on besides the ones stored on their own, and
+    // scene_hash the scene they were traced in.
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    int32_t width;
+    int32_t height;
+    uint64_t random_seed;
+    int32_t samples_per_pixel;
+    int32_t mode;
+    int32_t pass;
+    int64_t remaining_samples;
+    uint64_t settings_hash;
+    uint64_t scene_hash;
+};
+
+
+const char checkpoint_magic[8] = {'R', 'T', 'C', 'H', 'E', 'C', 'K', 'P'};
+const uint32_t checkpoint_version = 2;
+
+
+uint64_t hash_render_settings();
+uint64_t hash_scene(const Scene& scene);
+bool save_checkpoint(const char* file_name, const RenderState& state, const PixelAccumulator* accumulators);
+bool load_checkpoint(const char* file_name, RenderState& state, PixelAccumulator* accumulators);
+
+#endif
@@ -7,8 +7,11 @@ namespace constants
     const int WIDTH = 1000;
     const int HEIGHT = 1000;
     const int samples_per_pixel = 10;
+    const int samples_per_pass = 4;
     const int max_recursion_depth = 100;
     const int force_tracing_limit = 3;
+    const int tile_size = 16;
+    const unsigned long long random_seed = 0;
 
     const double EPSILON = 0.000001;
     const double max_ray_distance = 1.0 / 0.0;
@@ -16,8 +19,43 @@ namespace constants
 
     const bool enable_next_event_estimation = true;
 
+    const bool enable_environment_map = false;
+    const char* const environment_map_file_name = "./maps/environment.map";
+    const double environment_map_intensity = 1;
+
+    const bool enable_instanced_props = false;
+
     const bool enable_anti_aliasing = true;
 
+    const bool enable_wavefront_integrator = false;
+    const int wavefront_batch_size = 4096;
+
+    const bool enable_adaptive_sampling = false;
+    const int adaptive_min_samples = 4;
+    const int adaptive_max_samples = 100;
+    const int adaptive_samples_per_round = 4;
+    const double adaptive_error_threshold = 0.05;
+
+    const bool enable_progressive_rendering = false;
+    const int target_samples_per_pixel = 1000;
+    const double time_budget_seconds = 90;
+    const double progressive_refresh_interval = 5;
+
+    const int bvh_width = 4;
+    const int bvh_number_of_bins = 16;
+    const int bvh_max_leaf_size = 16;
+    const double bvh_traversal_cost = 1.0;
+    const double bvh_intersection_cost = 1.0;
+    const int bvh_parallel_subtree_threshold = 4096;
+    const int bvh_parallel_chunk_size = 16384;
+    const bool enable_single_precision_geometry = false;
+    const int obj_parallel_chunk_size = 4 * 1024 * 1024;
+    const bool enable_scene_cache = true;
+    const char* const scene_cache_extension = ".cache";
+
+    const bool enable_checkpoints = true;
+    const double checkpoint_interval = 60;
+
     const bool enable_denoising = true;
     const int denoising_iterations = 5;
     const double sigma_rt = 1;
@@ -26,6 +64,8 @@ namespace constants
 
     const char* const raw_file_name = "./temp/raw.dat";
     const char* const raw_denoised_file_name = "./temp/raw_denoised.dat";
+    const char* const sample_count_file_name = "./temp/sample_count.dat";
+    const char* const checkpoint_file_name = "./temp/checkpoint.dat";
 }
 
 #endif
@@ -0,0 +1,123 @@
+#include "environmentmap.h"
+#include <algorithm>
+#include <cmath>
+
+
+PiecewiseConstant1D::PiecewiseConstant1D(const std::vector<double>& _values){
+    values = _values;
+    int n = values.size();
+    cdf.resize(n + 1);
+    cdf[0] = 0;
+    for (int i = 0; i < n; i++){
+        cdf[i+1] = cdf[i] + values[i] / n;
+    }
+    value_integral = cdf[n];
+
+    for (int i = 1; i <= n; i++){
+        cdf[i] = value_integral > 0 ? cdf[i] / value_integral : double(i) / n;
+    }
+}
+
+double PiecewiseConstant1D::sample(const double u, double& pdf, int& bin) const{
+    // Returns a point in [0, 1) and the density there, and the bin it falls in.
+    int n = values.size();
+    bin = std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin() - 1;
+    bin = std::max(0, std::min(bin, n - 1));
+    pdf = this -> pdf(bin);
+
+    double offset = u - cdf[bin];
+    if (cdf[bin+1] > cdf[bin]){
+        offset /= cdf[bin+1] - cdf[bin];
+    }
+    return std::min((bin + offset) / n, 1 - 1e-16);
+}
+
+double PiecewiseConstant1D::pdf(const int bin) const{
+    return value_integral > 0 ? values[bin] / value_integral : 1;
+}
+
+double PiecewiseConstant1D::integral() const { return value_integral; }
+int PiecewiseConstant1D::size() const { return values.size(); }
+
+
+EnvironmentMap::EnvironmentMap(ValueMap3D* _radiance_map, const double _intensity){
+    radiance_map = _radiance_map;
+    intensity = _intensity;
+    width = radiance_map -> get_width();
+    height = radiance_map -> get_height();
+
+    std::vector<double> row_integrals(height);
+    double weighted_sum = 0;
+    double weight_sum = 0;
+    for (int y = 0; y < height; y++){
+        double sin_theta = sin(M_PI * (y + 0.5) / height);
+        std::vector<double> row_values(width);
+        for (int x = 0; x < width; x++){
+            row_values[x] = radiance_map -> get_texel(x, y).mean() * sin_theta;
+            weighted_sum += row_values[x];
+            weight_sum += sin_theta;
+        }
+        conditionals.push_back(PiecewiseConstant1D(row_values));
+        row_integrals[y] = conditionals[y].integral();
+    }
+    marginal = PiecewiseConstant1D(row_integrals);
+    average_radiance = intensity * weighted_sum / weight_sum;
+}
+
+EnvironmentMap::~EnvironmentMap(){
+    delete radiance_map;
+}
+
+
+void EnvironmentMap::direction_to_texel(const vec3& direction, int& x, int& y) const{
+    double theta = acos(std::max(-1.0, std::min(1.0, direction[1])));
+    double phi = atan2(direction[2], direction[0]);
+    if (phi < 0){
+        phi += 2 * M_PI;
+    }
+    x = std::min(int(width * phi / (2 * M_PI)), width - 1);
+    y = std::min(int(height * theta / M_PI), height - 1);
+}
+
+
+vec3 EnvironmentMap::radiance(const vec3& direction) const{
+    int x, y;
+    direction_to_texel(direction, x, y);
+    return radiance_map -> get_texel(x, y) * intensity;
+}
+
+
+vec3 EnvironmentMap::sample_direction(Sampler& sampler, double& pdf) const{
+    // Draws the row, then the column within it, and converts the density on the unit square to solid angle.
+    double row_pdf, column_pdf;
+    int x, y;
+    double v = marginal.sample(sampler.random_uniform(0, 1), row_pdf, y);
+    double u = conditionals[y].sample(sampler.random_uniform(0, 1), column_pdf, x);
+
+    double theta = v * M_PI;
+    double phi = u * 2 * M_PI;
+    double sin_theta = sin(theta);
+    if (sin_theta == 0){
+        pdf = 0;
+        return vec3(0, 1, 0);
+    }
+    pdf = row_pdf * column_pdf / (2 * M_PI * M_PI * sin_theta);
+    return vec3(sin_theta * cos(phi), cos(theta), sin_theta * sin(phi));
+}
+
+
+double EnvironmentMap::pdf(const vec3& direction) const{
+    int x, y;
+    direction_to_texel(direction, x, y);
+    double sin_theta = sqrt(std::max(0.0, 1 - direction[1] * direction[1]));
+    if (sin_theta == 0){
+        return 0;
+    }
+    return marginal.pdf(y) * conditionals[y].pdf(x) / (2 * M_PI * M_PI * sin_theta);
+}
+
+
+double EnvironmentMap::power(const double scene_radius) const{
+    // Light falling onto a sphere around the scene, in the units of Object::light_power, which leave out the factor pi.
+    return 4 * M_PI * scene_radius * scene_radius * average_radiance;
+}
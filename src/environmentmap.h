@@ -0,0 +1,59 @@
+#ifndef ENVIRONMENTMAP_H
+#define ENVIRONMENTMAP_H
+
+#include <vector>
+#include "vec3.h"
+#include "valuemap.h"
+#include "sampler.h"
+
+
+// Stands in for an object index where a light source is picked, when the environment is picked instead.
+const int environment_light_index = -2;
+
+
+class PiecewiseConstant1D{
+    // A distribution on [0, 1) with a constant density over each of n equal bins, proportional to the given values.
+    // Falls back to a uniform distribution when all values are zero.
+    public:
+        PiecewiseConstant1D(){}
+        PiecewiseConstant1D(const std::vector<double>& _values);
+
+        double sample(const double u, double& pdf, int& bin) const;
+        double pdf(const int bin) const;
+        double integral() const;
+        int size() const;
+
+    private:
+        std::vector<double> values;
+        std::vector<double> cdf; // n + 1 entries, from 0 to 1.
+        double value_integral;
+};
+
+
+class EnvironmentMap{
+    // Distant light around the scene, read from a latitude-longitude map. u runs around the y axis, and v from +y at
+    // the top row down to -y. Directions are drawn by a marginal distribution over the rows and a conditional one
+    // within every row, both proportional to the brightness of the texels times the sine of their polar angle, which
+    // is how much of the sphere they cover. Owns the map.
+    public:
+        EnvironmentMap(ValueMap3D* _radiance_map, const double _intensity=1);
+        ~EnvironmentMap();
+
+        vec3 radiance(const vec3& direction) const;
+        vec3 sample_direction(Sampler& sampler, double& pdf) const;
+        double pdf(const vec3& direction) const;
+        double power(const double scene_radius) const;
+
+    private:
+        ValueMap3D* radiance_map;
+        double intensity;
+        int width;
+        int height;
+        double average_radiance; // Over the sphere, as the mean of the color channels.
+        PiecewiseConstant1D marginal; // Over the rows.
+        std::vector<PiecewiseConstant1D> conditionals; // Within each row.
+
+        void direction_to_texel(const vec3& direction, int& x, int& y) const;
+};
+
+#endif
@@ -0,0 +1,129 @@
+#include "instance.h"
+
+
+Instance::Instance(TriangleMesh* _mesh, const Transform& _transform, Material* _material_override) : Object(_material_override){
+    mesh = _mesh;
+    transform = _transform;
+    material_override = _material_override;
+    if (material_override && material_override -> is_light_source){
+        throw std::invalid_argument("The material override of an instance cannot be a light source!");
+    }
+    area = mesh -> area * transform.get_scale() * transform.get_scale();
+
+    // The world bounds are the bounds of the transformed corners of the mesh bounds.
+    vec3 mesh_min = mesh -> min_axis_point();
+    vec3 mesh_max = mesh -> max_axis_point();
+    bounds_min = vec3(constants::max_ray_distance);
+    bounds_max = vec3(-constants::max_ray_distance);
+    for (int i = 0; i < 8; i++){
+        vec3 corner = vec3(i & 1 ? mesh_max[0] : mesh_min[0], i & 2 ? mesh_max[1] : mesh_min[1], i & 4 ? mesh_max[2] : mesh_min[2]);
+        vec3 world_corner = transform.point_to_world(corner);
+        for (int j = 0; j < 3; j++){
+            bounds_min.e[j] = std::min(bounds_min[j], world_corner[j]);
+            bounds_max.e[j] = std::max(bounds_max[j], world_corner[j]);
+        }
+    }
+}
+
+vec3 Instance::max_axis_point() const { return bounds_max; }
+vec3 Instance::min_axis_point() const { return bounds_min; }
+vec3 Instance::compute_centroid() const { return (bounds_min + bounds_max) / 2.0; }
+
+Material* Instance::get_material(const int primitive_ID) const{
+    if (material_override){
+        return material_override;
+    }
+    return mesh -> get_material(primitive_ID);
+}
+
+bool Instance::is_light_source() const {
+    return !material_override && mesh -> is_light_source();
+}
+
+double Instance::light_power() const {
+    return is_light_source() ? mesh -> light_power() * transform.get_scale() * transform.get_scale() : 0;
+}
+
+Hit Instance::to_object_hit(const Hit& hit) const{
+    // Only the position is needed in object space, for texture coordinates. Normals and directions stay in world space,
+    // where the outgoing directions of the materials also live.
+    Hit object_hit = hit;
+    object_hit.intersection_point = transform.point_to_object(hit.intersection_point);
+    return object_hit;
+}
+
+vec3 Instance::get_UV(const Hit& hit) const{
+    return mesh -> get_primitive_UV(transform.point_to_object(hit.intersection_point), hit.primitive_ID);
+}
+
+vec3 Instance::eval(const Hit& hit, const vec3& outgoing_vector) const{
+    if (material_override){
+        vec3 UV = get_UV(hit);
+        return material_override -> eval(hit, outgoing_vector, UV[0], UV[1]);
+    }
+    return mesh -> eval(to_object_hit(hit), outgoing_vector);
+}
+
+BrdfData Instance::sample(const Hit& hit, Sampler& sampler) const{
+    if (material_override){
+        vec3 UV = get_UV(hit);
+        return material_override -> sample(hit, UV[0], UV[1], sampler);
+    }
+    return mesh -> sample(to_object_hit(hit), sampler);
+}
+
+double Instance::brdf_pdf(const vec3& outgoing_vector, const Hit& hit) const{
+    if (material_override){
+        vec3 UV = get_UV(hit);
+        return material_override -> brdf_pdf(outgoing_vector, hit.incident_vector, hit.normal_vector, UV[0], UV[1]);
+    }
+    return mesh -> brdf_pdf(outgoing_vector, to_object_hit(hit));
+}
+
+vec3 Instance::get_light_emittance(const Hit& hit) const{
+    if (material_override){
+        vec3 UV = get_UV(hit);
+        return material_override -> get_light_emittance(UV[0], UV[1]);
+    }
+    return mesh -> get_light_emittance(to_object_hit(hit));
+}
+
+Ray Instance::to_object_ray(const Ray& ray) const{
+    // The object space direction is not normalized, so distances along it are the same as along the world ray.
+    Ray object_ray;
+    object_ray.starting_position = transform.point_to_object(ray.starting_position);
+    object_ray.direction_vector = transform.vector_to_object(ray.direction_vector);
+    object_ray.type = ray.type;
+    object_ray.t_max = ray.t_max;
+    object_ray.prepare();
+    return object_ray;
+}
+
+bool Instance::find_closest_object_hit(Hit& hit, Ray& ray) const{
+    Ray object_ray = to_object_ray(ray);
+    return mesh -> find_closest_object_hit(hit, object_ray);
+}
+
+bool Instance::find_any_object_hit(Hit& hit, Ray& ray) const{
+    Ray object_ray = to_object_ray(ray);
+    return mesh -> find_any_object_hit(hit, object_ray);
+}
+
+vec3 Instance::get_normal_vector(const vec3& surface_point, const int primitive_ID) const{
+    vec3 normal_vector = mesh -> get_normal_vector(transform.point_to_object(surface_point), primitive_ID);
+    return normalize_vector(transform.normal_to_world(normal_vector));
+}
+
+vec3 Instance::generate_random_surface_point(Sampler& sampler) const{
+    return transform.point_to_world(mesh -> generate_random_surface_point(sampler));
+}
+
+double Instance::light_pdf(const vec3& surface_point, const vec3& intersection_point, const int primitive_id) const{
+    // Solid angles are unchanged by similarity transforms, so the pdf of the mesh applies directly.
+    return mesh -> light_pdf(transform.point_to_object(surface_point), transform.point_to_object(intersection_point), primitive_id);
+}
+
+vec3 Instance::random_light_point(const vec3& intersection_point, double& pdf, Sampler& sampler) const{
+    vec3 object_point = mesh -> random_light_point(transform.point_to_object(intersection_point), pdf, sampler);
+    return transform.point_to_world(object_point);
+}
@@ -0,0 +1,50 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <stdexcept>
+#include "vec3.h"
+#include "utils.h"
+#include "materials.h"
+#include "objects.h"
+#include "trianglemesh.h"
+#include "transform.h"
+
+
+class Instance: public Object{
+    // A placement of a shared mesh. Rays are moved into the object space of the mesh, so its triangles and BVH exist
+    // only once however many instances there are. The mesh is owned by the scene, not by its instances. A material
+    // override replaces every material of the mesh, and must not be emissive, since light sampling on the instance
+    // uses the emitting triangles of the mesh.
+    public:
+        Instance(TriangleMesh* _mesh, const Transform& _transform, Material* _material_override=nullptr);
+
+        virtual vec3 max_axis_point() const override;
+        virtual vec3 min_axis_point() const override;
+        virtual vec3 compute_centroid() const override;
+        virtual Material* get_material(const int primitive_ID) const override;
+        virtual bool is_light_source() const override;
+        virtual double light_power() const override;
+        virtual vec3 eval(const Hit& hit, const vec3& outgoing_vector) const override;
+        virtual BrdfData sample(const Hit& hit, Sampler& sampler) const override;
+        virtual double brdf_pdf(const vec3& outgoing_vector, const Hit& hit) const override;
+        virtual vec3 get_light_emittance(const Hit& hit) const override;
+        virtual bool find_closest_object_hit(Hit& hit, Ray& ray) const override;
+        virtual bool find_any_object_hit(Hit& hit, Ray& ray) const override;
+        virtual vec3 get_normal_vector(const vec3& surface_point, const int primitive_ID) const override;
+        virtual vec3 generate_random_surface_point(Sampler& sampler) const override;
+        virtual double light_pdf(const vec3& surface_point, const vec3& intersection_point, const int primitive_id) const override;
+        virtual vec3 random_light_point(const vec3& intersection_point, double& pdf, Sampler& sampler) const override;
+
+    private:
+        TriangleMesh* mesh;
+        Transform transform;
+        Material* material_override;
+        vec3 bounds_min;
+        vec3 bounds_max;
+
+        Hit to_object_hit(const Hit& hit) const;
+        Ray to_object_ray(const Ray& ray) const;
+        vec3 get_UV(const Hit& hit) const;
+};
+
+#endif
@@ -0,0 +1,199 @@
+#include "integrator.h"
+
+
+vec3 light_hit_emission(const Hit& ray_hit, const SceneGeometry& geometry, const int depth, const int ray_type, const double scatter_pdf, const vec3& saved_point){
+    // If a light source is hit, compute the light_pdf based on the saved_point (previous hitpoint) and use MIS to weight the light.
+    Object* hit_object = geometry.objects[ray_hit.intersected_object_index];
+    bool is_specular_ray = ray_type == REFLECTED || ray_type == TRANSMITTED;
+    double weight;
+    if (!constants::enable_next_event_estimation || depth == 0 || is_specular_ray){
+        weight = 1;
+    }
+    else{
+        double light_pdf = geometry.light_selection_pdf(ray_hit.intersected_object_index) * hit_object -> light_pdf(ray_hit.intersection_point, saved_point, ray_hit.primitive_ID);
+        weight = mis_weight(1, scatter_pdf, 1, light_pdf);
+    }
+    vec3 light_emittance = hit_object -> get_light_emittance(ray_hit);
+    return weight * light_emittance; // TODO: What does this dot product do?  (dot_vectors(ray.direction_vector, ray_hit.normal_vector) < 0
+}
+
+
+vec3 environment_emission(const vec3& direction, const SceneGeometry& geometry, const int depth, const int ray_type, const double scatter_pdf){
+    // Same as light_hit_emission, for a ray that leaves the scene. The light pdf is already in solid angle.
+    if (!geometry.environment){
+        return vec3(0);
+    }
+    bool is_specular_ray = ray_type == REFLECTED || ray_type == TRANSMITTED;
+    double weight;
+    if (!constants::enable_next_event_estimation || depth == 0 || is_specular_ray){
+        weight = 1;
+    }
+    else{
+        double light_pdf = geometry.light_selection_pdf(environment_light_index) * geometry.environment -> pdf(direction);
+        weight = mis_weight(1, scatter_pdf, 1, light_pdf);
+    }
+    return weight * geometry.environment -> radiance(direction);
+}
+
+
+void update_medium_stack(MediumStack& medium_stack, const Hit& ray_hit, Object* hit_object, const vec3& outgoing_vector){
+    double incoming_dot_normal = dot_vectors(ray_hit.incident_vector, ray_hit.normal_vector);
+    double outgoing_dot_normal = dot_vectors(outgoing_vector, ray_hit.normal_vector);
+
+    bool penetrating_boundary = incoming_dot_normal * outgoing_dot_normal > 0;
+
+    // TODO: Do the below part before sampling, so we can get the correct medium for refractive index etc?
+    // TODO: Can save current_medium and next_medium, and pass that into sample and compute_direct_light.
+    Medium* new_medium = hit_object -> get_material(ray_hit.primitive_ID) -> medium;
+    if (penetrating_boundary && new_medium){
+        // Something about this is not really working, tries to pop medium while medium is not in stack. We enter multple times too.
+        // Seems to be an issue with concave objects, since the issue is not present for convex object unions (sphere etc).
+        // Probably due to numeric errors. Currently relatively rare, so can be ignored, but not very good.
+        if (ray_hit.outside){
+            medium_stack.add_medium(new_medium, ray_hit.intersected_object_index);
+        }
+        else{
+            medium_stack.pop_medium(ray_hit.intersected_object_index);
+        }
+    }
+}
+
+
+bool russian_roulette(vec3& throughput, const int depth, Sampler& sampler){
+    // Returns false if the path should be terminated, otherwise compensates the throughput for the survival probability.
+    if (depth < constants::force_tracing_limit){
+        return true;
+    }
+
+    double random_threshold = std::min(throughput.max(), 0.9);
+    double random_value = sampler.random_uniform(0, 1);
+    if (random_value >= random_threshold){
+        return false;
+    }
+
+    throughput /= random_threshold;
+    return true;
+}
+
+
+PixelData raytrace(Ray ray, const SceneGeometry& geometry, Medium* background_medium, Sampler& sampler){
+    Object** objects = geometry.objects;
+    MediumStack medium_stack = MediumStack();
+    medium_stack.add_medium(background_medium, -1);
+    PixelData data;
+    vec3 color = vec3(0,0,0);
+    vec3 throughput = vec3(1,1,1);
+    bool has_hit_surface = false;
+
+    vec3 saved_point;
+    double scatter_pdf = 0;
+
+    for (int depth = 0; depth <= constants::max_recursion_depth; depth++){
+        Medium* medium = medium_stack.get_medium();
+        double scatter_distance = medium -> sample_distance(sampler);
+
+        ray.t_max = scatter_distance;
+        Hit ray_hit;
+        if (!geometry.find_closest_hit(ray_hit, ray)){
+            if (scatter_distance == constants::max_ray_distance){
+                vec3 transmittance = medium -> sample(objects, geometry.number_of_objects, scatter_distance, false);
+                color += environment_emission(ray.direction_vector, geometry, depth, ray.type, scatter_pdf) * transmittance * throughput;
+                break;
+            }
+            ray_hit.distance = constants::max_ray_distance;
+        }
+        // save refractive indices here? Take from hit object + current/next medium?
+
+        bool scatter = scatter_distance < ray_hit.distance;
+        scatter_distance = std::min(scatter_distance, ray_hit.distance);
+        if (scatter){
+            color += medium -> sample_emission() * throughput;
+        }
+
+        throughput *= medium -> sample(objects, geometry.number_of_objects, scatter_distance, scatter);
+
+        if (scatter){
+            vec3 scatter_point = ray.starting_position + ray.direction_vector * scatter_distance;
+            vec3 scattered_direction = medium -> sample_direction(ray.direction_vector, sampler);
+            if (constants::enable_next_event_estimation){
+                ray_hit.intersection_point = scatter_point;
+
+                color += sample_light(ray_hit, geometry, medium_stack, true, sampler) * throughput;
+
+                ray.type = DIFFUSE;
+                scatter_pdf = medium -> phase_function(ray.direction_vector, scattered_direction);
+                saved_point = scatter_point;
+            }
+
+            ray.starting_position = scatter_point;
+            ray.direction_vector = scattered_direction;
+        }
+        else{
+            if (!has_hit_surface){
+                data.pixel_position = ray_hit.intersection_point;
+                data.pixel_normal = ray_hit.normal_vector;
+                has_hit_surface = true;
+            }
+
+            Object* hit_object = objects[ray_hit.intersected_object_index];
+
+            if (hit_object -> is_light_source()){
+                color += light_hit_emission(ray_hit, geometry, depth, ray.type, scatter_pdf, saved_point) * throughput;
+            }
+
+            if (constants::enable_next_event_estimation){
+                color += sample_light(ray_hit, geometry, medium_stack, false, sampler) * throughput;
+            }
+
+            BrdfData brdf_result = hit_object -> sample(ray_hit, sampler);
+            // TODO: Rename allow_direct_light!
+            // TODO: Rename is_virtual_surface variable...
+            bool is_virtual_surface = hit_object -> get_material(ray_hit.primitive_ID) -> allow_direct_light(); //This deviates from usual pattern of object method calling material method, but is better?
+            if (is_virtual_surface){
+                brdf_result.type = ray.type;
+            }
+            else{
+                scatter_pdf = brdf_result.pdf;
+                saved_point = ray_hit.intersection_point;
+            }
+            throughput *= brdf_result.brdf_over_pdf;
+
+            update_medium_stack(medium_stack, ray_hit, hit_object, brdf_result.outgoing_vector);
+            ray.starting_position = ray_hit.intersection_point;
+            ray.direction_vector = brdf_result.outgoing_vector;
+            ray.type = brdf_result.type;
+        }
+
+        if (!russian_roulette(throughput, depth, sampler)){
+            break;
+        }
+    }
+
+    data.pixel_color = color;
+    return data;
+ }
+
+
+Ray generate_camera_ray(const Camera& camera, const int x, const int y, Sampler& sampler){
+    Ray ray;
+    ray.starting_position = camera.position;
+    ray.type = TRANSMITTED;
+    double new_x = x;
+    double new_y = y;
+
+    if (constants::enable_anti_aliasing){
+        new_x += sampler.random_normal() / 3.0;
+        new_y += sampler.random_normal() / 3.0;
+    }
+
+    ray.direction_vector = camera.get_starting_directions(new_x, new_y);
+    return ray;
+}
+
+
+PixelData sample_pixel(const int x, const int y, const int sample_index, const Scene& scene){
+    int pixel_index = (constants::HEIGHT - y) * constants::WIDTH + x;
+    Sampler sampler = Sampler(pixel_index, sample_index);
+    Ray ray = generate_camera_ray(*scene.camera, x, y, sampler);
+    return raytrace(ray, *scene.geometry, scene.medium, sampler);
+}
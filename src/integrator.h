@@ -0,0 +1,22 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "vec3.h"
+#include "utils.h"
+#include "objects.h"
+#include "medium.h"
+#include "camera.h"
+#include "scene.h"
+#include "accumulator.h"
+
+
+vec3 light_hit_emission(const Hit& ray_hit, const SceneGeometry& geometry, const int depth, const int ray_type, const double scatter_pdf, const vec3& saved_point);
+vec3 environment_emission(const vec3& direction, const SceneGeometry& geometry, const int depth, const int ray_type, const double scatter_pdf);
+void update_medium_stack(MediumStack& medium_stack, const Hit& ray_hit, Object* hit_object, const vec3& outgoing_vector);
+bool russian_roulette(vec3& throughput, const int depth, Sampler& sampler);
+
+PixelData raytrace(Ray ray, const SceneGeometry& geometry, Medium* background_medium, Sampler& sampler);
+Ray generate_camera_ray(const Camera& camera, const int x, const int y, Sampler& sampler);
+PixelData sample_pixel(const int x, const int y, const int sample_index, const Scene& scene);
+
+#endif
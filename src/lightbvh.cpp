@@ -0,0 +1,187 @@
+#include "lightbvh.h"
+#include <algorithm>
+#include <cmath>
+
+
+vec3 rotate_vector(const vec3& vector, const vec3& unit_axis, const double angle){
+    // Rodrigues' rotation formula.
+    return vector * cos(angle) + cross_vectors(unit_axis, vector) * sin(angle) + unit_axis * (dot_vectors(unit_axis, vector) * (1 - cos(angle)));
+}
+
+
+LightBounds merge_light_bounds(const LightBounds& a, const LightBounds& b){
+    LightBounds merged;
+    merged.bounds = a.bounds;
+    BVH::grow_box(merged.bounds, b.bounds);
+    merged.power = a.power + b.power;
+
+    // Cones are compared up to sign, so b is flipped to the side of a first.
+    vec3 b_axis = dot_vectors(a.axis, b.axis) < 0 ? -b.axis : b.axis;
+    double theta_a = acos(std::max(-1.0, std::min(1.0, a.cos_theta_o)));
+    double theta_b = acos(std::max(-1.0, std::min(1.0, b.cos_theta_o)));
+    double theta_d = acos(std::max(-1.0, std::min(1.0, dot_vectors(a.axis, b_axis))));
+    if (std::min(theta_d + theta_b, M_PI) <= theta_a){
+        merged.axis = a.axis;
+        merged.cos_theta_o = a.cos_theta_o;
+        return merged;
+    }
+    if (std::min(theta_d + theta_a, M_PI) <= theta_b){
+        merged.axis = b_axis;
+        merged.cos_theta_o = b.cos_theta_o;
+        return merged;
+    }
+
+    double theta_o = (theta_a + theta_d + theta_b) / 2;
+    vec3 rotation_axis = cross_vectors(a.axis, b_axis);
+    if (theta_o >= M_PI || rotation_axis.length_squared() == 0){
+        merged.axis = a.axis;
+        merged.cos_theta_o = -1;
+        return merged;
+    }
+    merged.axis = normalize_vector(rotate_vector(a.axis, normalize_vector(rotation_axis), theta_o - theta_a));
+    merged.cos_theta_o = cos(theta_o);
+    return merged;
+}
+
+
+double light_importance(const LightBounds& bounds, const vec3& point){
+    // An upper bound of the cosine at the emitters, over the power and the squared distance to the center of the
+    // bounds. The distance is clamped, so emitters next to or around the point do not get unbounded weight.
+    vec3 center = (bounds.bounds.min_point + bounds.bounds.max_point) / 2.0;
+    vec3 difference = point - center;
+    double radius = (bounds.bounds.max_point - bounds.bounds.min_point).length() / 2.0;
+    double distance_squared = std::max(difference.length_squared(), radius);
+    if (distance_squared == 0 || bounds.power == 0){
+        return bounds.power;
+    }
+
+    double cos_theta_w = std::abs(dot_vectors(bounds.axis, normalize_vector(difference)));
+    double sin_theta_w = sqrt(std::max(0.0, 1 - cos_theta_w * cos_theta_w));
+    double sin_theta_o = sqrt(std::max(0.0, 1 - bounds.cos_theta_o * bounds.cos_theta_o));
+
+    // Angle from the axis that is left after the cone, then after the angle the bounds take up as seen from the point.
+    double cos_theta_x = 1;
+    if (cos_theta_w < bounds.cos_theta_o){
+        cos_theta_x = cos_theta_w * bounds.cos_theta_o + sin_theta_w * sin_theta_o;
+    }
+    double cos_theta_b = -1;
+    if (difference.length_squared() > radius * radius){
+        cos_theta_b = sqrt(1 - radius * radius / difference.length_squared());
+    }
+    double cos_theta = 1;
+    if (cos_theta_x < cos_theta_b){
+        double sin_theta_x = sqrt(std::max(0.0, 1 - cos_theta_x * cos_theta_x));
+        double sin_theta_b = sqrt(std::max(0.0, 1 - cos_theta_b * cos_theta_b));
+        cos_theta = cos_theta_x * cos_theta_b + sin_theta_x * sin_theta_b;
+    }
+    if (cos_theta <= 0){
+        return 0;
+    }
+    return bounds.power * cos_theta / distance_squared;
+}
+
+
+LightBVH::LightBVH(const std::vector<LightBounds>& lights){
+    if (lights.empty()){
+        return;
+    }
+    std::vector<int> light_indices(lights.size());
+    for (size_t i = 0; i < lights.size(); i++){
+        light_indices[i] = i;
+    }
+    light_leaves.resize(lights.size());
+    nodes.reserve(2 * lights.size() - 1);
+    build_subtree(lights, light_indices, 0, lights.size(), -1);
+}
+
+
+int LightBVH::build_subtree(const std::vector<LightBounds>& lights, std::vector<int>& light_indices, const int start, const int end, const int parent){
+    // Splits at the median centroid along the widest axis, which keeps the tree, and so the walk to a leaf, short.
+    int node_index = nodes.size();
+    nodes.push_back(LightBVHNode());
+    nodes[node_index].parent = parent;
+    nodes[node_index].second_child = -1;
+    nodes[node_index].light_index = -1;
+
+    if (end - start == 1){
+        nodes[node_index].bounds = lights[light_indices[start]];
+        nodes[node_index].light_index = light_indices[start];
+        light_leaves[light_indices[start]] = node_index;
+        return node_index;
+    }
+
+    BVH::AxisAlignedBox centroid_bounds = BVH::empty_box();
+    for (int i = start; i < end; i++){
+        const BVH::AxisAlignedBox& box = lights[light_indices[i]].bounds;
+        BVH::grow_box(centroid_bounds, (box.min_point + box.max_point) / 2.0);
+    }
+    int axis = argmax(centroid_bounds.max_point - centroid_bounds.min_point);
+    int middle = start + (end - start) / 2;
+    std::nth_element(light_indices.begin() + start, light_indices.begin() + middle, light_indices.begin() + end, [&lights, axis](const int a, const int b){
+        return lights[a].bounds.min_point[axis] + lights[a].bounds.max_point[axis] < lights[b].bounds.min_point[axis] + lights[b].bounds.max_point[axis];
+    });
+
+    int first_child = build_subtree(lights, light_indices, start, middle, node_index);
+    int second_child = build_subtree(lights, light_indices, middle, end, node_index);
+    nodes[node_index].second_child = second_child;
+    nodes[node_index].bounds = merge_light_bounds(nodes[first_child].bounds, nodes[second_child].bounds);
+    return node_index;
+}
+
+
+double LightBVH::first_child_probability(const int node_index, const vec3& point) const{
+    // Returns -1 if neither child is expected to contribute.
+    double first_importance = light_importance(nodes[node_index + 1].bounds, point);
+    double second_importance = light_importance(nodes[nodes[node_index].second_child].bounds, point);
+    if (first_importance + second_importance == 0){
+        return -1;
+    }
+    return first_importance / (first_importance + second_importance);
+}
+
+
+int LightBVH::sample(const vec3& point, const double u, double& pdf) const{
+    // Descends with a single random number, rescaling it to [0, 1) after every choice. Returns -1 with zero pdf when
+    // no light can reach the point.
+    pdf = 0;
+    if (nodes.empty()){
+        return -1;
+    }
+    double remaining_u = u;
+    double path_pdf = 1;
+    int node_index = 0;
+    while (nodes[node_index].second_child != -1){
+        double first_probability = first_child_probability(node_index, point);
+        if (first_probability < 0){
+            return -1;
+        }
+        if (remaining_u < first_probability){
+            remaining_u = std::min(remaining_u / first_probability, 1 - 1e-16);
+            path_pdf *= first_probability;
+            node_index = node_index + 1;
+        }
+        else{
+            remaining_u = std::min((remaining_u - first_probability) / (1 - first_probability), 1 - 1e-16);
+            path_pdf *= 1 - first_probability;
+            node_index = nodes[node_index].second_child;
+        }
+    }
+    pdf = path_pdf;
+    return nodes[node_index].light_index;
+}
+
+
+double LightBVH::pdf(const vec3& point, const int light_index) const{
+    double path_pdf = 1;
+    int node_index = light_leaves[light_index];
+    while (nodes[node_index].parent != -1){
+        int parent = nodes[node_index].parent;
+        double first_probability = first_child_probability(parent, point);
+        if (first_probability < 0){
+            return 0;
+        }
+        path_pdf *= node_index == parent + 1 ? first_probability : 1 - first_probability;
+        node_index = parent;
+    }
+    return path_pdf;
+}
@@ -0,0 +1,51 @@
+#ifndef LIGHTBVH_H
+#define LIGHTBVH_H
+
+#include <vector>
+#include "vec3.h"
+#include "bvh.h"
+
+
+struct LightBounds{
+    // Bounds of a group of emitters: where they are, which way they face and how much they emit. Emitters shine from
+    // both sides, so the cone bounds the normals up to sign, and cos_theta_o is the cosine of its half angle.
+    BVH::AxisAlignedBox bounds;
+    vec3 axis;
+    double cos_theta_o;
+    double power;
+};
+
+
+struct LightBVHNode{
+    LightBounds bounds;
+    int parent;
+    int second_child; // The first child follows its parent directly. -1 for leaves.
+    int light_index; // Only set for leaves.
+};
+
+
+LightBounds merge_light_bounds(const LightBounds& a, const LightBounds& b);
+double light_importance(const LightBounds& bounds, const vec3& point);
+
+
+class LightBVH{
+    // A binary tree over emitters, with one emitter per leaf. Sampling descends from the root and picks each child with
+    // probability proportional to an estimate of how much light it sends towards the shading point, from its power,
+    // its distance and its cone of normals. pdf walks the same path up from the leaf of a light, so it is exactly the
+    // probability with which sample picks it.
+    public:
+        LightBVH(){}
+        LightBVH(const std::vector<LightBounds>& lights);
+
+        int sample(const vec3& point, const double u, double& pdf) const;
+        double pdf(const vec3& point, const int light_index) const;
+
+    private:
+        std::vector<LightBVHNode> nodes;
+        std::vector<int> light_leaves; // Node index of the leaf of every light.
+
+        int build_subtree(const std::vector<LightBounds>& lights, std::vector<int>& light_indices, const int start, const int end, const int parent);
+        double first_child_probability(const int node_index, const vec3& point) const;
+};
+
+#endif
@@ -1,8 +1,11 @@
 #include <iostream>
 #include <fstream>
+#include <string>
 #include <chrono>
 #include <stdexcept>
-#include <thread>
+#include <vector>
+#include <functional>
+#include <algorithm>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
@@ -13,7 +16,15 @@
 #include "camera.h"
 #include "utils.h"
 #include "constants.h"
-#include "objectunion.h"
+#include "trianglemesh.h"
+#include "threadpool.h"
+#include "accumulator.h"
+#include "checkpoint.h"
+#include "scene.h"
+#include "integrator.h"
+#include "wavefront.h"
+#include "instance.h"
+#include "transform.h"
 
 
 void print_pixel_color(const vec3& rgb, std::ofstream& file){
@@ -21,188 +32,22 @@ void print_pixel_color(const vec3& rgb, std::ofstream& file){
 }
 
 
-struct Scene{
-    Object** objects;
-    int number_of_objects;
-    Camera* camera;
-    MaterialManager* material_manager;
-    Medium* medium;
-};
-
-
-struct PixelData{
-    vec3 pixel_color = vec3(0,0,0);
-    vec3 pixel_position = vec3(0,0,0);
-    vec3 pixel_normal = vec3(0,0,0);
-};
-
-
-PixelData raytrace(Ray ray, Object** objects, const int number_of_objects, Medium* background_medium){
-    MediumStack medium_stack = MediumStack();
-    medium_stack.add_medium(background_medium, -1);
-    PixelData data;
-    vec3 color = vec3(0,0,0);
-    vec3 throughput = vec3(1,1,1);
-    double random_threshold = 1;
-    bool allow_recursion = true;
-    bool has_hit_surface = false;
-
-    vec3 saved_point;
-    double scatter_pdf;
-
-    for (int depth = 0; depth <= constants::max_recursion_depth; depth++){
-        Medium* medium = medium_stack.get_medium();
-        double scatter_distance = medium -> sample_distance();
-
-        ray.t_max = scatter_distance;
-        Hit ray_hit;
-        if (!find_closest_hit(ray_hit, ray, objects, number_of_objects)){
-            if (scatter_distance == constants::max_ray_distance){
-                break;
-            }
-            ray_hit.distance = constants::max_ray_distance;
-        }
-        // save refractive indices here? Take from hit object + current/next medium?
-
-        bool scatter = scatter_distance < ray_hit.distance;
-        scatter_distance = std::min(scatter_distance, ray_hit.distance);
-        if (scatter){
-            color += medium -> sample_emission() * throughput;
-        }
-
-        throughput *= medium -> sample(objects, number_of_objects, scatter_distance, scatter);
-
-        if (scatter){
-            vec3 scatter_point = ray.starting_position + ray.direction_vector * scatter_distance;
-            vec3 scattered_direction = medium -> sample_direction(ray.direction_vector);
-            if (constants::enable_next_event_estimation){
-                ray_hit.intersection_point = scatter_point;
-
-                color += sample_light(ray_hit, objects, number_of_objects, medium_stack, true) * throughput;
-
-                ray.type = DIFFUSE;
-                scatter_pdf = medium -> phase_function(ray.direction_vector, scattered_direction);
-                saved_point = scatter_point;
-            }
-
-            ray.starting_position = scatter_point;
-            ray.direction_vector = scattered_direction;
-        }
-        else{
-            if (!has_hit_surface){
-                data.pixel_position = ray_hit.intersection_point;
-                data.pixel_normal = ray_hit.normal_vector;
-                has_hit_surface = true;
-            }
-
-            bool is_specular_ray = ray.type == REFLECTED || ray.type == TRANSMITTED;
-            Object* hit_object = objects[ray_hit.intersected_object_index];
-
-            // If a light source is hit, compute the light_pdf based on the saved_point (previous hitpoint) and use MIS to add the light.
-            // Could move this to a separate function, make it clearer what it is doing.
-            if (hit_object -> is_light_source()){
-                double weight;
-                if (!constants::enable_next_event_estimation || depth == 0 || is_specular_ray){
-                    weight = 1;
-                }
-                else{
-                    double light_pdf = objects[ray_hit.intersected_object_index] -> light_pdf(ray_hit.intersection_point, saved_point, ray_hit.primitive_ID);
-                    weight = mis_weight(1, scatter_pdf, 1, light_pdf);
-                }
-                vec3 light_emittance = hit_object -> get_light_emittance(ray_hit);
-
-                color += weight * light_emittance * throughput; // TODO: What does this dot product do?  (dot_vectors(ray.direction_vector, ray_hit.normal_vector) < 0
-            }
-
-            if (constants::enable_next_event_estimation){
-                color += sample_light(ray_hit, objects, number_of_objects, medium_stack, false) * throughput;//hit_object -> sample_direct(ray_hit, objects, number_of_objects, medium_stack) * throughput;
-            }
-
-            BrdfData brdf_result = hit_object -> sample(ray_hit);
-            // TODO: Rename allow_direct_light!
-            // TODO: Rename is_virtual_surface variable...
-            bool is_virtual_surface = hit_object -> get_material(ray_hit.primitive_ID) -> allow_direct_light(); //This deviates from usual pattern of object method calling material method, but is better?
-            if (is_virtual_surface){
-                brdf_result.type = ray.type;
-            }
-            else{
-                scatter_pdf = brdf_result.pdf;
-                saved_point = ray_hit.intersection_point;
-            }
-            throughput *= brdf_result.brdf_over_pdf;
-
-            double incoming_dot_normal = dot_vectors(ray_hit.incident_vector, ray_hit.normal_vector);
-            double outgoing_dot_normal = dot_vectors(brdf_result.outgoing_vector, ray_hit.normal_vector);
-
-            bool penetrating_boundary = incoming_dot_normal * outgoing_dot_normal > 0;
-
-            // TODO: Do the below part before sampling, so we can get the correct medium for refractive index etc?
-            // TODO: Can save current_medium and next_medium, and pass that into sample and compute_direct_light.
-            Medium* new_medium = hit_object -> get_material(ray_hit.primitive_ID) -> medium;
-            if (penetrating_boundary && new_medium){
-                // Something about this is not really working, tries to pop medium while medium is not in stack. We enter multple times too.
-                // Seems to be an issue with concave objects, since the issue is not present for convex object unions (sphere etc).
-                // Probably due to numeric errors. Currently relatively rare, so can be ignored, but not very good.
-                if (ray_hit.outside){
-                    medium_stack.add_medium(new_medium, ray_hit.intersected_object_index);
-                }
-                else{
-                    medium_stack.pop_medium(ray_hit.intersected_object_index);
-                }
-            }
-            ray.starting_position = ray_hit.intersection_point;
-            ray.direction_vector = brdf_result.outgoing_vector;
-            ray.type = brdf_result.type;
-        }
-
-        if (depth < constants::force_tracing_limit){
-            random_threshold = 1;
-            allow_recursion = true;
-        }
-        else{
-            random_threshold = std::min(throughput.max(), 0.9);
-            double random_value = random_uniform(0, 1);
-            allow_recursion = random_value < random_threshold;
-        }
-
-        if (!allow_recursion){
-            break;
-        }
-
-        throughput /= random_threshold;
+void render_pixels(const std::vector<PixelWork>& work, const Scene& scene, PixelAccumulator* accumulators, WavefrontIntegrator* integrator){
+    // The sample index continues from the samples already taken, so every sample of a pixel uses its own random sequence.
+    if (constants::enable_wavefront_integrator){
+        integrator -> render(work, accumulators);
+        return;
     }
 
-    data.pixel_color = color;
-    return data;
- }
-
-
-PixelData compute_pixel_color(const int x, const int y, const Scene& scene){
-    PixelData data;
-    vec3 pixel_color = vec3(0,0,0);
-    for (int i = 0; i < constants::samples_per_pixel; i++){
-        Ray ray;
-        ray.starting_position = scene.camera -> position;
-        ray.type = TRANSMITTED;
-        double new_x = x;
-        double new_y = y;
-
-        if (constants::enable_anti_aliasing){
-            new_x += random_normal() / 3.0;
-            new_y += random_normal() / 3.0;
+    for (size_t i = 0; i < work.size(); i++){
+        int idx = work[i].pixel_index;
+        int x = idx % constants::WIDTH;
+        int y = constants::HEIGHT - idx / constants::WIDTH;
+        PixelAccumulator& accumulator = accumulators[idx];
+        for (int j = 0; j < work[i].number_of_samples; j++){
+            accumulator.add_sample(sample_pixel(x, y, accumulator.number_of_samples, scene));
         }
-
-        ray.direction_vector = scene.camera -> get_starting_directions(new_x, new_y);
-        PixelData sampled_data = raytrace(ray, scene.objects, scene.number_of_objects, scene.medium);
-        data.pixel_position = sampled_data.pixel_position;
-        data.pixel_normal = sampled_data.pixel_normal;
-        pixel_color += sampled_data.pixel_color;
     }
-
-    data.pixel_color = pixel_color / (double) constants::samples_per_pixel;
-    data.pixel_position = data.pixel_position / (double) constants::samples_per_pixel;
-    data.pixel_normal = data.pixel_normal / (double) constants::samples_per_pixel;
-    return data;
 }
 
 
@@ -281,26 +126,62 @@ Scene create_scene_old(){
     manager -> add_material(mirror_material);
 
     Plane* this_floor = new Plane(vec3(0,0,0), vec3(1,0,0), vec3(0,0,-1), white_diffuse_material);
-    Rectangle* front_wall = new Rectangle(vec3(0,1.55,-0.35), vec3(1,0,0), vec3(0,1,0), 2, 1.55*2, white_diffuse_material);
-    Rectangle* left_wall = new Rectangle(vec3(-1,1.55,1.575), vec3(0,0,-1), vec3(0,1,0), 3.85, 1.55*2, white_diffuse_material);
-    Rectangle* right_wall = new Rectangle(vec3(1,1.55,1.575), vec3(0,0,1), vec3(0,1,0), 3.85, 1.55*2, white_diffuse_material);
-    Plane* roof = new Plane(vec3(0,2.2,0), vec3(1,0,0), vec3(0,0,1), white_diffuse_material);
-    Rectangle* back_wall = new Rectangle(vec3(0,1.55,3.5), vec3(0,1,0), vec3(1,0,0), 3.85, 1.55*2, white_diffuse_material);
 
     Sphere* ball1 = new Sphere(vec3(0, 0.8, 1), 0.35, glass_material);
     Sphere* ball2 = new Sphere(vec3(-0.3, 0.3, 1.3), 0.2, gold_material);
 
-    Sphere* light_source = new Sphere(vec3(0, 2.199, 0), 0.2, light_source_material);
-
     double desired_size = 0.6;
     vec3 desired_center = vec3(-0.3, 0.1, 1.3);
     bool smooth_shade = false;
     bool transform_object = true;
     // TODO: Actually, use struct called object_transform, can set it to nullptr if no transformation should be made.
-    ObjectUnion* loaded_model = load_object_model("./models/water_cube.obj", scattering_glass_material, smooth_shade, transform_object, desired_center, desired_size);
+    TriangleMesh* loaded_model = load_object_model("./models/water_cube.obj", scattering_glass_material, smooth_shade, transform_object, desired_center, desired_size);
+
+    Scene scene;
+    int number_of_objects;
+    Object** objects;
+    if (constants::enable_environment_map){
+        // The room would keep out the light of the environment, so only the floor and what stands on it are kept.
+        ValueMap3D* environment_radiance = create_value_map_3D(constants::environment_map_file_name);
+        if (!environment_radiance){
+            throw std::invalid_argument("Could not open environment map " + std::string(constants::environment_map_file_name) + ".");
+        }
+        scene.environment = new EnvironmentMap(environment_radiance, constants::environment_map_intensity);
+        number_of_objects = 3;
+        objects = new Object*[number_of_objects]{this_floor, ball2, loaded_model};
+    }
+    else{
+        Rectangle* front_wall = new Rectangle(vec3(0,1.55,-0.35), vec3(1,0,0), vec3(0,1,0), 2, 1.55*2, white_diffuse_material);
+        Rectangle* left_wall = new Rectangle(vec3(-1,1.55,1.575), vec3(0,0,-1), vec3(0,1,0), 3.85, 1.55*2, white_diffuse_material);
+        Rectangle* right_wall = new Rectangle(vec3(1,1.55,1.575), vec3(0,0,1), vec3(0,1,0), 3.85, 1.55*2, white_diffuse_material);
+        Plane* roof = new Plane(vec3(0,2.2,0), vec3(1,0,0), vec3(0,0,1), white_diffuse_material);
+        Rectangle* back_wall = new Rectangle(vec3(0,1.55,3.5), vec3(0,1,0), vec3(1,0,0), 3.85, 1.55*2, white_diffuse_material);
+        Sphere* light_source = new Sphere(vec3(0, 2.199, 0), 0.2, light_source_material);
+        number_of_objects = 8;
+        objects = new Object*[number_of_objects]{this_floor, front_wall, left_wall, right_wall, roof, back_wall, light_source, loaded_model};
+    }
 
-    int number_of_objects = 8;
-    Object** objects = new Object*[number_of_objects]{this_floor, front_wall, left_wall, right_wall, roof, back_wall, light_source, loaded_model};
+    if (constants::enable_instanced_props){
+        // Two small lamps and a red block on the floor, all instances of one emissive copy of the model. The copy is
+        // placed around desired_center, so each transform scales and rotates it about that point before moving it.
+        TriangleMesh* lamp_mesh = load_object_model("./models/water_cube.obj", light_source_material, smooth_shade, transform_object, desired_center, desired_size);
+        scene.meshes.push_back(lamp_mesh);
+        vec3 prop_positions[3] = {vec3(0.15, 0.052, 1.6), vec3(-0.55, 0.052, 0.6), vec3(0.5, 0.098, 1.1)};
+        double prop_sizes[3] = {0.09, 0.09, 0.17};
+        double prop_angles[3] = {0.4, 1.1, 0.7};
+
+        Object** all_objects = new Object*[number_of_objects + 3];
+        std::copy(objects, objects + number_of_objects, all_objects);
+        for (int i = 0; i < 3; i++){
+            double prop_scale = prop_sizes[i] / desired_size;
+            Transform rotation = Transform(vec3(0), vec3(0, 1, 0), prop_angles[i], prop_scale);
+            Transform transform = Transform(prop_positions[i] - rotation.point_to_world(desired_center), vec3(0, 1, 0), prop_angles[i], prop_scale);
+            all_objects[number_of_objects + i] = new Instance(lamp_mesh, transform, i < 2 ? nullptr : red_diffuse_material);
+        }
+        delete[] objects;
+        objects = all_objects;
+        number_of_objects += 3;
+    }
 
     ScatteringMediumHomogenous* background_medium = new ScatteringMediumHomogenous(vec3(0.), (colors::WHITE) * 0.0, vec3(0));
 
@@ -309,10 +190,10 @@ Scene create_scene_old(){
     vec3 screen_y_vector = vec3(0, 1, 0);
     Camera* camera = new Camera(camera_position, viewing_direction, screen_y_vector);
 
-    Scene scene;
     scene.objects = objects;
     scene.camera = camera;
     scene.number_of_objects = number_of_objects;
+    scene.geometry = new SceneGeometry(objects, number_of_objects, scene.environment);
     scene.material_manager = manager;
     scene.medium = background_medium;
     return scene;
@@ -325,30 +206,38 @@ void clear_scene(Scene& scene){
     }
 
     delete[] scene.objects;
+    for (TriangleMesh* mesh : scene.meshes){
+        delete mesh;
+    }
+    delete scene.geometry;
     delete scene.material_manager;
     delete scene.camera;
     delete scene.medium;
+    delete scene.environment;
 }
 
 
-void raytrace_section(const int start_idx, const int number_of_pixels, const Scene& scene, double* image, vec3* position_buffer, vec3* normal_buffer){
-    for (int i = 0; i < number_of_pixels; i++){
-        int idx = start_idx + i;
+struct Tile{
+    int start_row;
+    int end_row;
+    int start_column;
+    int end_column;
+};
 
-        int x = idx % constants::WIDTH;
-        int y = constants::HEIGHT - idx / constants::WIDTH;
-        PixelData data = compute_pixel_color(x, y, scene);
 
-        vec3 pixel_color = tone_map(data.pixel_color);
-        for (int j = 0; j < 3; j++){
-            image[3*idx+j] = pixel_color[j];
+std::vector<Tile> create_tiles(const int tile_size){
+    std::vector<Tile> tiles;
+    for (int row = 0; row < constants::HEIGHT; row += tile_size){
+        for (int column = 0; column < constants::WIDTH; column += tile_size){
+            Tile tile;
+            tile.start_row = row;
+            tile.end_row = std::min(row + tile_size, constants::HEIGHT);
+            tile.start_column = column;
+            tile.end_column = std::min(column + tile_size, constants::WIDTH);
+            tiles.push_back(tile);
         }
-
-        position_buffer[idx] = data.pixel_position;
-        normal_buffer[idx] = data.pixel_normal;
-
     }
-    std::clog << "Thread complete.\n";
+    return tiles;
 }
 
 
@@ -394,7 +283,217 @@ void close_mmap(double* mmap_file, const size_t file_size, const int fd){
 }
 
 
-int main() {
+void run_on_tiles(ThreadPool& thread_pool, const std::function<void(const Tile&, const int)>& function){
+    // Each worker starts out with a contiguous block of tiles, and workers that run out steal from the others. The function
+    // is also given the index of the worker that ends up rendering the tile, for state kept per worker.
+    std::vector<Tile> tiles = create_tiles(constants::tile_size);
+    int number_of_threads = thread_pool.get_number_of_threads();
+    int tiles_per_thread = std::ceil(tiles.size() / (double) number_of_threads);
+
+    TaskGroup group;
+    for (size_t i = 0; i < tiles.size(); i++){
+        const Tile& tile = tiles[i];
+        thread_pool.run(group, [&thread_pool, &tile, &function](){
+            function(tile, thread_pool.get_worker_index());
+        }, i / tiles_per_thread);
+    }
+    thread_pool.wait(group);
+}
+
+
+void checkpoint_if_due(const RenderState& state, const PixelAccumulator* accumulators, std::chrono::steady_clock::time_point& last_checkpoint){
+    // Only called between passes, when no worker is writing to the accumulators.
+    if (!constants::enable_checkpoints){
+        return;
+    }
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - last_checkpoint).count() < constants::checkpoint_interval){
+        return;
+    }
+    if (save_checkpoint(constants::checkpoint_file_name, state, accumulators)){
+        std::clog << "Saved checkpoint after pass " << state.pass << ".\n";
+    }
+    last_checkpoint = now;
+}
+
+
+void raytrace_fixed(ThreadPool& thread_pool, const Scene& scene, const std::vector<WavefrontIntegrator*>& integrators, PixelAccumulator* accumulators, RenderState& state){
+    // Samples are taken in passes so the render can be checkpointed in between. Pixels are topped up to the target
+    // count, which lets a resumed render continue from whatever each pixel had reached.
+    std::chrono::steady_clock::time_point last_checkpoint = std::chrono::steady_clock::now();
+    while (state.pass * constants::samples_per_pass < constants::samples_per_pixel){
+        run_on_tiles(thread_pool, [&scene, &integrators, accumulators](const Tile& tile, const int worker_index){
+            std::vector<PixelWork> work;
+            for (int row = tile.start_row; row < tile.end_row; row++){
+                for (int column = tile.start_column; column < tile.end_column; column++){
+                    int idx = row * constants::WIDTH + column;
+                    int missing_samples = constants::samples_per_pixel - accumulators[idx].number_of_samples;
+                    work.push_back({idx, std::min(constants::samples_per_pass, missing_samples)});
+                }
+            }
+            render_pixels(work, scene, accumulators, integrators[worker_index]);
+        });
+        state.pass++;
+        checkpoint_if_due(state, accumulators, last_checkpoint);
+    }
+}
+
+
+int select_adaptive_samples(const PixelAccumulator* accumulators, int* samples_to_take, long long& remaining_samples){
+    // Gives the next batch of samples to the pixels whose relative error is above the threshold. If the remaining budget
+    // cannot cover all of them, the noisiest pixels are served first.
+    std::vector<int> active_pixels;
+    for (int i = 0; i < constants::WIDTH * constants::HEIGHT; i++){
+        samples_to_take[i] = 0;
+        bool below_cap = accumulators[i].number_of_samples < constants::adaptive_max_samples;
+        if (below_cap && accumulators[i].get_relative_error() > constants::adaptive_error_threshold){
+            active_pixels.push_back(i);
+        }
+    }
+
+    if (remaining_samples <= 0){
+        return 0;
+    }
+
+    int samples_per_pixel = constants::adaptive_samples_per_round;
+    if ((long long) active_pixels.size() * samples_per_pixel > remaining_samples){
+        std::sort(active_pixels.begin(), active_pixels.end(), [accumulators](const int a, const int b){
+            double error_a = accumulators[a].get_relative_error();
+            double error_b = accumulators[b].get_relative_error();
+            return error_a > error_b || (error_a == error_b && a < b);
+        });
+        samples_per_pixel = std::min((long long) samples_per_pixel, remaining_samples);
+        long long number_of_pixels_to_keep = samples_per_pixel == 0 ? 0 : remaining_samples / samples_per_pixel;
+        active_pixels.resize(std::min((long long) active_pixels.size(), number_of_pixels_to_keep));
+    }
+
+    for (size_t i = 0; i < active_pixels.size(); i++){
+        int idx = active_pixels[i];
+        samples_to_take[idx] = std::min(samples_per_pixel, constants::adaptive_max_samples - accumulators[idx].number_of_samples);
+        remaining_samples -= samples_to_take[idx];
+    }
+    return active_pixels.size();
+}
+
+
+void raytrace_adaptive(ThreadPool& thread_pool, const Scene& scene, const std::vector<WavefrontIntegrator*>& integrators, PixelAccumulator* accumulators, RenderState& state){
+    // The total budget is the same as for a fixed number of samples per pixel, but after an initial pass it is spent in
+    // rounds on the pixels that have not yet converged.
+    int number_of_pixels = constants::WIDTH * constants::HEIGHT;
+    int* samples_to_take = new int[number_of_pixels];
+    int number_of_active_pixels;
+    if (state.pass == 0){
+        for (int i = 0; i < number_of_pixels; i++){
+            samples_to_take[i] = constants::adaptive_min_samples;
+        }
+        state.remaining_samples = (long long) (constants::samples_per_pixel - constants::adaptive_min_samples) * number_of_pixels;
+        number_of_active_pixels = number_of_pixels;
+    }
+    else{
+        number_of_active_pixels = select_adaptive_samples(accumulators, samples_to_take, state.remaining_samples);
+    }
+
+    std::chrono::steady_clock::time_point last_checkpoint = std::chrono::steady_clock::now();
+    while (number_of_active_pixels > 0){
+        run_on_tiles(thread_pool, [&scene, &integrators, accumulators, samples_to_take](const Tile& tile, const int worker_index){
+            std::vector<PixelWork> work;
+            for (int row = tile.start_row; row < tile.end_row; row++){
+                for (int column = tile.start_column; column < tile.end_column; column++){
+                    int idx = row * constants::WIDTH + column;
+                    if (samples_to_take[idx] > 0){
+                        work.push_back({idx, samples_to_take[idx]});
+                    }
+                }
+            }
+            render_pixels(work, scene, accumulators, integrators[worker_index]);
+        });
+        std::clog << "Adaptive sampling round " << state.pass << ": " << number_of_active_pixels << " active pixels.\n";
+        state.pass++;
+        checkpoint_if_due(state, accumulators, last_checkpoint);
+
+        number_of_active_pixels = select_adaptive_samples(accumulators, samples_to_take, state.remaining_samples);
+    }
+
+    delete[] samples_to_take;
+}
+
+
+void write_pixel_buffers(const PixelAccumulator* accumulators, double* image, vec3* position_buffer, vec3* normal_buffer){
+    for (int idx = 0; idx < constants::WIDTH * constants::HEIGHT; idx++){
+        PixelData data = accumulators[idx].get_mean();
+        vec3 pixel_color = tone_map(data.pixel_color);
+        for (int j = 0; j < 3; j++){
+            image[3*idx+j] = pixel_color[j];
+        }
+
+        position_buffer[idx] = data.pixel_position;
+        normal_buffer[idx] = data.pixel_normal;
+    }
+}
+
+
+void raytrace_progressive(ThreadPool& thread_pool, const Scene& scene, const std::vector<WavefrontIntegrator*>& integrators, PixelAccumulator* accumulators, RenderState& state, double* image, vec3* position_buffer, vec3* normal_buffer){
+    // Accumulates one sample per pixel and pass until the target is reached or the time budget runs out. Tiles that have
+    // not been started when the deadline passes are skipped, their pixels simply end up with one sample less.
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point deadline = begin + std::chrono::milliseconds((long long) (1000 * constants::time_budget_seconds));
+    std::chrono::steady_clock::time_point last_refresh = begin;
+    std::chrono::steady_clock::time_point last_checkpoint = begin;
+
+    while (state.pass < constants::target_samples_per_pixel && std::chrono::steady_clock::now() < deadline){
+        run_on_tiles(thread_pool, [&scene, &integrators, accumulators, &deadline](const Tile& tile, const int worker_index){
+            if (std::chrono::steady_clock::now() >= deadline){
+                return;
+            }
+            std::vector<PixelWork> work;
+            for (int row = tile.start_row; row < tile.end_row; row++){
+                for (int column = tile.start_column; column < tile.end_column; column++){
+                    work.push_back({row * constants::WIDTH + column, 1});
+                }
+            }
+            render_pixels(work, scene, accumulators, integrators[worker_index]);
+        });
+        state.pass++;
+        print_progress(state.pass / (double) constants::target_samples_per_pixel);
+        checkpoint_if_due(state, accumulators, last_checkpoint);
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - last_refresh).count() >= constants::progressive_refresh_interval){
+            write_pixel_buffers(accumulators, image, position_buffer, normal_buffer);
+            last_refresh = now;
+        }
+    }
+    std::clog << "\nProgressive rendering finished after " << state.pass << " passes.\n";
+}
+
+
+void write_sample_counts(const PixelAccumulator* accumulators){
+    // Written in the same raw double format as the images, one value per pixel.
+    int number_of_pixels = constants::WIDTH * constants::HEIGHT;
+    size_t file_size = number_of_pixels * sizeof(double);
+    int sample_count_fd;
+    double* sample_counts = create_mmap(constants::sample_count_file_name, file_size, sample_count_fd);
+    long long total_samples = 0;
+    for (int i = 0; i < number_of_pixels; i++){
+        sample_counts[i] = accumulators[i].number_of_samples;
+        total_samples += accumulators[i].number_of_samples;
+    }
+    close_mmap(sample_counts, file_size, sample_count_fd);
+    std::clog << "Average samples per pixel: " << total_samples / (double) number_of_pixels << ".\n";
+}
+
+
+int main(int argc, char* argv[]) {
+    bool resume = false;
+    for (int i = 1; i < argc; i++){
+        if (std::string(argv[i]) == "--resume"){
+            resume = true;
+        }
+        else{
+            std::clog << "Unknown argument: " << argv[i] << "\n";
+        }
+    }
+
     std::chrono::steady_clock::time_point begin_build = std::chrono::steady_clock::now();
 
     Scene scene = create_scene();
@@ -408,23 +507,63 @@ int main() {
     vec3* position_buffer = new vec3[constants::WIDTH * constants::HEIGHT];
     vec3* normal_buffer = new vec3[constants::WIDTH * constants::HEIGHT];
 
-    int number_of_threads = std::thread::hardware_concurrency() - 1;
-    std::clog << "Running program with number of threads: " << number_of_threads << ".\n";
-    std::thread thread_array[number_of_threads];
+    ThreadPool& thread_pool = get_thread_pool();
+    std::clog << "Running program with number of threads: " << thread_pool.get_number_of_threads() << ".\n";
 
     int image_fd;
     double *image = create_mmap(constants::raw_file_name, FILESIZE, image_fd);
 
-    int pixels_per_thread = std::ceil(constants::WIDTH * constants::HEIGHT / (double) number_of_threads);
-    for (int i = 0; i < number_of_threads; i++){
-        int start_idx = pixels_per_thread * i;
-        int pixels_to_handle = std::min(pixels_per_thread, constants::WIDTH * constants::HEIGHT - i * pixels_per_thread);
-        thread_array[i] = std::thread(raytrace_section, start_idx, pixels_to_handle, scene, image, position_buffer, normal_buffer);
+    PixelAccumulator* accumulators = new PixelAccumulator[constants::WIDTH * constants::HEIGHT];
+    RenderState state;
+    state.scene_hash = hash_scene(scene);
+    if (constants::enable_progressive_rendering){
+        state.mode = PROGRESSIVE_RENDERING;
+    }
+    else if (constants::enable_adaptive_sampling){
+        state.mode = ADAPTIVE_RENDERING;
+    }
+
+    if (resume){
+        if (load_checkpoint(constants::checkpoint_file_name, state, accumulators)){
+            std::clog << "Resuming from checkpoint after pass " << state.pass << ".\n";
+        }
+        else{
+            std::clog << "No usable checkpoint found, starting a new render.\n";
+            std::fill(accumulators, accumulators + constants::WIDTH * constants::HEIGHT, PixelAccumulator());
+            state.pass = 0;
+            state.remaining_samples = 0;
+        }
+    }
+
+    // The wavefront integrators are kept for the whole render, one per worker, so their path buffers are only allocated once.
+    std::vector<WavefrontIntegrator*> integrators(thread_pool.get_number_of_threads(), nullptr);
+    if (constants::enable_wavefront_integrator){
+        for (size_t i = 0; i < integrators.size(); i++){
+            integrators[i] = new WavefrontIntegrator(scene, constants::wavefront_batch_size);
+        }
+    }
+
+    thread_pool.reset_statistics();
+    if (state.mode == PROGRESSIVE_RENDERING){
+        raytrace_progressive(thread_pool, scene, integrators, accumulators, state, image, position_buffer, normal_buffer);
+    }
+    else if (state.mode == ADAPTIVE_RENDERING){
+        raytrace_adaptive(thread_pool, scene, integrators, accumulators, state);
+    }
+    else{
+        raytrace_fixed(thread_pool, scene, integrators, accumulators, state);
+    }
+    thread_pool.print_statistics();
+
+    for (size_t i = 0; i < integrators.size(); i++){
+        delete integrators[i];
     }
 
-    for (int i = 0; i < number_of_threads; i++){
-        thread_array[i].join();
+    write_pixel_buffers(accumulators, image, position_buffer, normal_buffer);
+    if (constants::enable_adaptive_sampling || constants::enable_progressive_rendering){
+        write_sample_counts(accumulators);
     }
+    delete[] accumulators;
 
     std::cout << constants::WIDTH << std::endl;
 
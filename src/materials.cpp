@@ -47,13 +47,18 @@ Material::~Material(){
 bool Material::allow_direct_light() const { return false; }
 bool Material::compute_direct_light() const { return false; }
 vec3 Material::eval(const Hit& hit, const vec3& outgoing_vector, const double u, const double v) const{ return vec3(0); }
-BrdfData Material::sample(const Hit& hit, const double u, const double v) const{ return BrdfData(); }
+BrdfData Material::sample(const Hit& hit, const double u, const double v, Sampler& sampler) const{ return BrdfData(); }
 double Material::brdf_pdf(const vec3& outgoing_vector, const vec3& incident_vector, const vec3& normal_vector, const double u, const double v) const{ return 0; }
 
 vec3 Material::get_light_emittance(const double u, const double v) const{
     return emission_color_map -> get(u, v) * light_intensity_map -> get(u, v);
 }
 
+double Material::average_emittance() const{
+    // Estimated from the mean color and mean intensity, averaged over the color channels.
+    return emission_color_map -> average().mean() * light_intensity_map -> average();
+}
+
 
 bool DiffuseMaterial::compute_direct_light() const{
     return true;
@@ -63,8 +68,8 @@ vec3 DiffuseMaterial::eval(const Hit& hit, const vec3& outgoing_vector, const do
     return albedo_map -> get(u, v) / M_PI;
 }
 
-BrdfData DiffuseMaterial::sample(const Hit& hit, const double u, const double v) const{
-    vec3 outgoing_vector = sample_cosine_hemisphere(hit.normal_vector);
+BrdfData DiffuseMaterial::sample(const Hit& hit, const double u, const double v, Sampler& sampler) const{
+    vec3 outgoing_vector = sample_cosine_hemisphere(hit.normal_vector, sampler);
     BrdfData data;
     data.outgoing_vector = outgoing_vector;
     data.brdf_over_pdf = albedo_map -> get(u, v);
@@ -82,7 +87,7 @@ vec3 ReflectiveMaterial::eval(const Hit& hit, const vec3& outgoing_vector, const
     return colors::BLACK;
 }
 
-BrdfData ReflectiveMaterial::sample(const Hit& hit, const double u, const double v) const{
+BrdfData ReflectiveMaterial::sample(const Hit& hit, const double u, const double v, Sampler& sampler) const{
     vec3 outgoing_vector = reflect_vector(hit.incident_vector, hit.normal_vector);
     BrdfData data;
     data.outgoing_vector = outgoing_vector;
@@ -101,7 +106,7 @@ vec3 TransparentMaterial::eval(const Hit& hit, const vec3& outgoing_vector, cons
     return colors::BLACK;
 }
 
-BrdfData TransparentMaterial::sample(const Hit& hit, const double u, const double v) const{
+BrdfData TransparentMaterial::sample(const Hit& hit, const double u, const double v, Sampler& sampler) const{
     // TODO: Look at the current medium, use that as refractive index! Update for extinction coefficient!
     double n1, n2;
     if (hit.outside){
@@ -121,7 +126,7 @@ BrdfData TransparentMaterial::sample(const Hit& hit, const double u, const doubl
         F_r = fresnel_multiplier(cos_incident, n1, 0, n2, 0, true);
     }
 
-    double random_num = random_uniform(0, 1);
+    double random_num = sampler.random_uniform(0, 1);
     bool is_reflected = random_num <= F_r;
 
     BrdfData data;
@@ -179,10 +184,10 @@ double MicrofacetMaterial::G(const vec3& half_vector, const vec3& normal_vector,
     return G1(half_vector, normal_vector, -incident_vector, alpha) * G1(half_vector, normal_vector, outgoing_vector, alpha);
 }
 
-vec3 MicrofacetMaterial::sample_half_vector(const vec3& normal_vector, const double alpha) const{
+vec3 MicrofacetMaterial::sample_half_vector(const vec3& normal_vector, const double alpha, Sampler& sampler) const{
     // Samples half_angle_vector
-    double r1 = random_uniform(0, 1);
-    double r2 = random_uniform(0, 1);
+    double r1 = sampler.random_uniform(0, 1);
+    double r2 = sampler.random_uniform(0, 1);
     double phi = 2 * M_PI * r2;
     double tan_theta2 = - alpha * alpha * std::log(1 - r1);
     double cos_theta2 = 1.0 / (1.0 + tan_theta2);
@@ -241,20 +246,20 @@ vec3 GlossyMaterial::eval(const Hit& hit, const vec3& outgoing_vector, const dou
     return diffuse + specular;
 }
 
-vec3 GlossyMaterial::sample_outgoing(const vec3& incident_vector, const vec3& normal_vector, const double u, const double v) const{
-    double rand_1 = random_uniform(0, 1);
+vec3 GlossyMaterial::sample_outgoing(const vec3& incident_vector, const vec3& normal_vector, const double u, const double v, Sampler& sampler) const{
+    double rand_1 = sampler.random_uniform(0, 1);
     if (rand_1 <= 0.5){
-        return sample_cosine_hemisphere(normal_vector);
+        return sample_cosine_hemisphere(normal_vector, sampler);
     }
     else{
-        vec3 half_vector = sample_half_vector(normal_vector, get_alpha(u, v));
+        vec3 half_vector = sample_half_vector(normal_vector, get_alpha(u, v), sampler);
         return reflect_vector(incident_vector, half_vector);
     }
 }
 
-BrdfData GlossyMaterial::sample(const Hit& hit, const double u, const double v) const{
+BrdfData GlossyMaterial::sample(const Hit& hit, const double u, const double v, Sampler& sampler) const{
     BrdfData brdf_data;
-    brdf_data.outgoing_vector = sample_outgoing(hit.incident_vector, hit.normal_vector, u, v);
+    brdf_data.outgoing_vector = sample_outgoing(hit.incident_vector, hit.normal_vector, u, v, sampler);
     brdf_data.pdf = brdf_pdf(brdf_data.outgoing_vector, hit.incident_vector, hit.normal_vector, u, v);
     brdf_data.brdf_over_pdf = brdf_data.pdf == 0 ? 0 : eval(hit, brdf_data.outgoing_vector, u, v) * dot_vectors(brdf_data.outgoing_vector, hit.normal_vector) / brdf_data.pdf;
     brdf_data.type = DIFFUSE;
@@ -298,14 +303,14 @@ vec3 MetallicMicrofacet::eval(const Hit& hit, const vec3& outgoing_vector, const
     return specular;
 }
 
-vec3 MetallicMicrofacet::sample_outgoing(const vec3& incident_vector, const vec3& normal_vector, const double u, const double v) const{
-    vec3 half_vector = sample_half_vector(normal_vector, get_alpha(u, v));
+vec3 MetallicMicrofacet::sample_outgoing(const vec3& incident_vector, const vec3& normal_vector, const double u, const double v, Sampler& sampler) const{
+    vec3 half_vector = sample_half_vector(normal_vector, get_alpha(u, v), sampler);
     return reflect_vector(incident_vector, half_vector);
 }
 
-BrdfData MetallicMicrofacet::sample(const Hit& hit, const double u, const double v) const{
+BrdfData MetallicMicrofacet::sample(const Hit& hit, const double u, const double v, Sampler& sampler) const{
     BrdfData brdf_data;
-    brdf_data.outgoing_vector = sample_outgoing(hit.incident_vector, hit.normal_vector, u, v);
+    brdf_data.outgoing_vector = sample_outgoing(hit.incident_vector, hit.normal_vector, u, v, sampler);
     brdf_data.pdf = brdf_pdf(brdf_data.outgoing_vector, hit.incident_vector, hit.normal_vector, u, v);
     brdf_data.brdf_over_pdf = brdf_data.pdf == 0 ? 0 : eval(hit, brdf_data.outgoing_vector, u, v) * dot_vectors(brdf_data.outgoing_vector, hit.normal_vector) / brdf_data.pdf;
     brdf_data.type = DIFFUSE;
@@ -326,7 +331,7 @@ vec3 TransparentMicrofacetMaterial::eval(const Hit& hit, const vec3& outgoing_ve
     return vec3(0.0);
 };
 
-vec3 TransparentMicrofacetMaterial::sample_outgoing(vec3& half_vector, const vec3& incident_vector, const vec3& normal_vector, const bool outside, const double u, const double v) const{
+vec3 TransparentMicrofacetMaterial::sample_outgoing(vec3& half_vector, const vec3& incident_vector, const vec3& normal_vector, const bool outside, const double u, const double v, Sampler& sampler) const{
     double n1, n2;
     if (outside){
         n1 = constants::air_refractive_index;
@@ -337,13 +342,13 @@ vec3 TransparentMicrofacetMaterial::sample_outgoing(vec3& half_vector, const vec
         n2 = constants::air_refractive_index;
     }
 
-    half_vector = sample_half_vector(normal_vector, get_alpha(u, v));
+    half_vector = sample_half_vector(normal_vector, get_alpha(u, v), sampler);
 
     double i_dot_h = -dot_vectors(incident_vector, half_vector);
     double F_r = fresnel_multiplier(i_dot_h, n1, 0, n2, 0, true);
 
     vec3 refracted_vector = refract_vector(incident_vector, -half_vector, n1 / n2);
-    double rand_num = random_uniform(0, 1);
+    double rand_num = sampler.random_uniform(0, 1);
     if (rand_num <= F_r || refracted_vector.length_squared() == 0){
         return reflect_vector(incident_vector, half_vector);
     }
@@ -351,11 +356,11 @@ vec3 TransparentMicrofacetMaterial::sample_outgoing(vec3& half_vector, const vec
     return refracted_vector;
 }
 
-BrdfData TransparentMicrofacetMaterial::sample(const Hit& hit, const double u, const double v) const{
+BrdfData TransparentMicrofacetMaterial::sample(const Hit& hit, const double u, const double v, Sampler& sampler) const{
     BrdfData brdf_data;
 
     vec3 half_vector;
-    brdf_data.outgoing_vector = sample_outgoing(half_vector, hit.incident_vector, hit.normal_vector, hit.outside, u, v);
+    brdf_data.outgoing_vector = sample_outgoing(half_vector, hit.incident_vector, hit.normal_vector, hit.outside, u, v, sampler);
 
     double cosine_factor = dot_vectors(hit.incident_vector, half_vector) / (dot_vectors(hit.incident_vector, hit.normal_vector) * dot_vectors(half_vector, hit.normal_vector));
     brdf_data.brdf_over_pdf = G(half_vector, hit.normal_vector, hit.incident_vector, brdf_data.outgoing_vector, get_alpha(u, v)) * cosine_factor;
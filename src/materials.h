@@ -77,9 +77,10 @@ class Material{
     virtual bool allow_direct_light() const;
     virtual bool compute_direct_light() const;
     virtual vec3 eval(const Hit& hit, const vec3& outgoing_vector, const double u, const double v) const;
-    virtual BrdfData sample(const Hit& hit, const double u, const double v) const;
+    virtual BrdfData sample(const Hit& hit, const double u, const double v, Sampler& sampler) const;
     virtual double brdf_pdf(const vec3& outgoing_vector, const vec3& incident_vector, const vec3& normal_vector, const double u, const double v) const;
     vec3 get_light_emittance(const double u, const double v) const;
+    double average_emittance() const;
 };
 
 
@@ -89,7 +90,7 @@ class DiffuseMaterial : public Material{
 
     bool compute_direct_light() const override;
     vec3 eval(const Hit& hit, const vec3& outgoing_vector, const double u, const double v) const override;
-    BrdfData sample(const Hit& hit, const double u, const double v) const override;
+    BrdfData sample(const Hit& hit, const double u, const double v, Sampler& sampler) const override;
     double brdf_pdf(const vec3& outgoing_vector, const vec3& incident_vector, const vec3& normal_vector, const double u, const double v) const override;
 };
 
@@ -99,7 +100,7 @@ class ReflectiveMaterial : public Material{
         using Material::Material;
 
     vec3 eval(const Hit& hit, const vec3& outgoing_vector, const double u, const double v) const override;
-    BrdfData sample(const Hit& hit, const double u, const double v) const override;
+    BrdfData sample(const Hit& hit, const double u, const double v, Sampler& sampler) const override;
     double brdf_pdf(const vec3& outgoing_vector, const vec3& incident_vector, const vec3& normal_vector, const double u, const double v) const override;
 };
 
@@ -110,7 +111,7 @@ class TransparentMaterial : public Material{
 
     bool allow_direct_light() const override;
     vec3 eval(const Hit& hit, const vec3& outgoing_vector, const double u, const double v) const override;
-    BrdfData sample(const Hit& hit, const double u, const double v) const override;
+    BrdfData sample(const Hit& hit, const double u, const double v, Sampler& sampler) const override;
 };
 
 
@@ -124,7 +125,7 @@ class MicrofacetMaterial : public Material{
     double D(const vec3& half_vector, const vec3& normal_vector, const double alpha) const;
     double G1(const vec3& half_vector, const vec3& normal_vector, const vec3& v, const double alpha) const;
     double G(const vec3& half_vector, const vec3& normal_vector, const vec3& incident_vector, const vec3& outgoing_vector, const double alpha) const;
-    vec3 sample_half_vector(const vec3& normal_vector, const double alpha) const;
+    vec3 sample_half_vector(const vec3& normal_vector, const double alpha, Sampler& sampler) const;
     BrdfData sample_transmission(const MicrofacetSampleArgs& args) const;
     double diffuse_pdf(const vec3& outgoing_vector, const vec3& normal_vector) const;
     double specular_pdf(const vec3& outgoing_vector, const vec3& incident_vector, const vec3& normal_vector, const double u, const double v) const;
@@ -135,8 +136,8 @@ class GlossyMaterial : public MicrofacetMaterial{
     public:
         using MicrofacetMaterial::MicrofacetMaterial;
     vec3 eval(const Hit& hit, const vec3& outgoing_vector, const double u, const double v) const override;
-    vec3 sample_outgoing(const vec3& incident_vector, const vec3& normal_vector, const double u, const double v) const;
-    BrdfData sample(const Hit& hit, const double u, const double v) const override;
+    vec3 sample_outgoing(const vec3& incident_vector, const vec3& normal_vector, const double u, const double v, Sampler& sampler) const;
+    BrdfData sample(const Hit& hit, const double u, const double v, Sampler& sampler) const override;
     double brdf_pdf(const vec3& outgoing_vector, const vec3& incident_vector, const vec3& normal_vector, const double u, const double v) const override;
 };
 
@@ -146,8 +147,8 @@ class MetallicMicrofacet : public MicrofacetMaterial{
         using MicrofacetMaterial::MicrofacetMaterial;
 
     vec3 eval(const Hit& hit, const vec3& outgoing_vector, const double u, const double v) const override;
-    vec3 sample_outgoing(const vec3& incident_vector, const vec3& normal_vector, const double u, const double v) const;
-    BrdfData sample(const Hit& hit, const double u, const double v) const override;
+    vec3 sample_outgoing(const vec3& incident_vector, const vec3& normal_vector, const double u, const double v, Sampler& sampler) const;
+    BrdfData sample(const Hit& hit, const double u, const double v, Sampler& sampler) const override;
     double brdf_pdf(const vec3& outgoing_vector, const vec3& incident_vector, const vec3& normal_vector, const double u, const double v) const override;
 };
 
@@ -158,8 +159,8 @@ class TransparentMicrofacetMaterial : public MicrofacetMaterial{
 
     bool compute_direct_light() const override;
     vec3 eval(const Hit& hit, const vec3& outgoing_vector, const double u, const double v) const override;
-    vec3 sample_outgoing(vec3& half_vector, const vec3& incident_vector, const vec3& normal_vector, const bool outside, const double u, const double v) const;
-    BrdfData sample(const Hit& hit, const double u, const double v) const override;
+    vec3 sample_outgoing(vec3& half_vector, const vec3& incident_vector, const vec3& normal_vector, const bool outside, const double u, const double v, Sampler& sampler) const;
+    BrdfData sample(const Hit& hit, const double u, const double v, Sampler& sampler) const override;
     double brdf_pdf(const vec3& outgoing_vector, const vec3& incident_vector, const vec3& normal_vector, const double u, const double v) const override;
 };
 
@@ -6,12 +6,12 @@ scattering_albedo(_scattering_albedo), absorption_albedo(_absorption_albedo), em
     extinction_albedo = absorption_albedo + scattering_albedo;
 }
 
-double Medium::sample_distance() const{
+double Medium::sample_distance(Sampler& sampler) const{
     return constants::max_ray_distance;
 }
 
-vec3 Medium::sample_direction(const vec3& incident_vector) const{
-    return sample_spherical();
+vec3 Medium::sample_direction(const vec3& incident_vector, Sampler& sampler) const{
+    return sample_spherical(sampler);
 }
 
 double Medium::phase_function(const vec3& incident_vector, const vec3& outgoing_vector) const{
@@ -19,6 +19,14 @@ double Medium::phase_function(const vec3& incident_vector, const vec3& outgoing_
 }
 
 vec3 Medium::transmittance_albedo(const double distance) const{
+    if (distance == constants::max_ray_distance){
+        // Towards the environment. Channels without extinction let everything through, where the product would be nan.
+        vec3 transmittance;
+        for (int i = 0; i < 3; i++){
+            transmittance.e[i] = extinction_albedo[i] > 0 ? 0 : 1;
+        }
+        return transmittance;
+    }
     return exp_vector(-extinction_albedo * distance);
 }
 
@@ -38,12 +46,12 @@ vec3 BeersLawMedium::sample(Object** object, const int number_of_objects, const
 }
 
 
-double ScatteringMediumHomogenous::sample_distance() const{
-    int channel = random_int(0, 3);
+double ScatteringMediumHomogenous::sample_distance(Sampler& sampler) const{
+    int channel = sampler.random_int(0, 3);
     if (extinction_albedo[channel] == 0){
         return constants::max_ray_distance;
     }
-    return -std::log(random_uniform(0, 1)) / extinction_albedo[channel];
+    return -std::log(sampler.random_uniform(0, 1)) / extinction_albedo[channel];
 }
 
 vec3 ScatteringMediumHomogenous::sample(Object** objects, const int number_of_objects, const double distance, const bool scatter) const{
@@ -69,57 +77,57 @@ vec3 ScatteringMediumHomogenous::sample_emission() const{
 
 
 MediumStack::MediumStack(){ stack_size = 0; }
-MediumStack::MediumStack(Medium** initial_array, const int size){
-    stack_size = 0;
-    for (int i = 0; i < size; i++){
-        add_medium(initial_array[i], initial_array[i] -> id);
-    }
-}
 
-MediumStack::~MediumStack(){
-    delete[] medium_array;
+MediumStack::MediumStack(const MediumStack& other){
+    *this = other;
 }
 
-Medium** MediumStack::get_array() const { return medium_array; }
-int MediumStack::get_stack_size() const { return stack_size; }
+MediumStack& MediumStack::operator=(const MediumStack& other){
+    // Only the used entries are copied.
+    stack_size = other.stack_size;
+    for (int i = 0; i < stack_size; i++){
+        entries[i] = other.entries[i];
+    }
+    return *this;
+}
 
 Medium* MediumStack::get_medium() const{
     if(stack_size == 0){
         return nullptr;
     }
 
-    return medium_array[stack_size-1];
+    return entries[stack_size-1].medium;
 }
 
 void MediumStack::add_medium(Medium* medium, const int id){
     // Call this when entering a new medium.
-    //std::cout << "Add! Size (before addition is made): " << stack_size << ", id: " << id << "\n";
     if (stack_size == MAX_STACK_SIZE){
         throw std::invalid_argument("Cannot add another medium to stack, stack is full!");
     }
-    bool found = false;
     for (int i = 0; i < stack_size; i++){
-        if (medium_array[i] -> id == id){
-            //std::cout << "Error: 1. Found a medium with same ID!\n";
+        if (entries[i].owner_id == id){
             return;
         }
     }
 
-    medium -> id = id;
-    medium_array[stack_size] = medium;
+    entries[stack_size].medium = medium;
+    entries[stack_size].owner_id = id;
     stack_size++;
 }
 
 void MediumStack::pop_medium(const int id){
-    // Call this when exiting a medium.
-    //std::cout << "Remove! Size (before addition is made): " << stack_size << ", id: " << id << "\n";
+    // Call this when exiting a medium. The medium need not be the innermost one when objects overlap.
     for (int i = stack_size-1; i >= 0; i--){
-        if (medium_array[i] -> id == id){
-            medium_array[i] = nullptr;
+        if (entries[i].owner_id == id){
+            for (int j = i; j < stack_size-1; j++){
+                entries[j] = entries[j+1];
+            }
             stack_size--;
             return;
         }
     }
-    //std::cout << "Error: 2. Could not remove medium from stack because no matching medium was found!\n";
-    //throw std::invalid_argument("Could not remove medium from stack because no matching medium was found!");
+}
+
+void MediumStack::clear(){
+    stack_size = 0;
 }
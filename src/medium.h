@@ -9,32 +9,38 @@ class Object;
 class Medium;
 
 
+struct MediumStackEntry{
+    Medium* medium;
+    int owner_id; // Index of the object the medium fills, or -1 for the medium of the scene.
+};
+
+
 class MediumStack{
+    // The media a path is currently inside of, innermost last. The entries are stored inline, so a stack is created and
+    // copied without allocating, and each keeps the ID of its owner, so the shared Medium objects are never written to.
     public:
         MediumStack();
-        MediumStack(Medium** initial_array, const int stack_size);
-        ~MediumStack();
+        MediumStack(const MediumStack& other);
+        MediumStack& operator=(const MediumStack& other);
 
-        Medium** get_array() const;
-        int get_stack_size() const;
         Medium* get_medium() const;
         void add_medium(Medium* medium, const int id);
         void pop_medium(const int id);
+        void clear();
 
     private:
-        const int MAX_STACK_SIZE = 50;
+        static const int MAX_STACK_SIZE = 50;
         int stack_size;
-        Medium** medium_array = new Medium*[MAX_STACK_SIZE];
+        MediumStackEntry entries[MAX_STACK_SIZE];
 };
 
 
 class Medium{
     public:
-        int id;
         Medium(const vec3& _scattering_albedo, const vec3& _absorption_albedo, const vec3& _emission_coefficient);
 
-        virtual double sample_distance() const;
-        virtual vec3 sample_direction(const vec3& incident_vector) const;
+        virtual double sample_distance(Sampler& sampler) const;
+        virtual vec3 sample_direction(const vec3& incident_vector, Sampler& sampler) const;
         virtual double phase_function(const vec3& incident_vector, const vec3& outgoing_vector) const;
         virtual vec3 transmittance_albedo(const double distance) const;
         virtual vec3 sample(Object** objects, const int number_of_objects, const double distance, const bool scatter) const;
@@ -58,7 +64,7 @@ class BeersLawMedium: public Medium{
 class ScatteringMediumHomogenous : public Medium{
     public:
         using Medium::Medium;
-        virtual double sample_distance() const override;
+        virtual double sample_distance(Sampler& sampler) const override;
         virtual vec3 sample(Object** objects, const int number_of_objects, const double distance, const bool scatter) const override;
         virtual vec3 sample_emission() const override;
 };
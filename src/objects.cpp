@@ -1,24 +1,28 @@
 #include "objects.h"
+#include "scenegeometry.h"
 
 
 // ****** Object base class implementation ******
 Object::Object(Material* _material) : material(_material), area(0.0), primitive_ID(0) {}
 
+primitive_type Object::get_primitive_type() const { return GENERIC_PRIMITIVE; }
+bool Object::is_bounded() const { return true; }
 vec3 Object::max_axis_point() const { return vec3(); }
 vec3 Object::min_axis_point() const { return vec3(); }
 vec3 Object::compute_centroid() const { return vec3(); }
 vec3 Object::get_UV(const vec3& point) const { return vec3(); }
 Material* Object::get_material(const int primitive_ID) const { return material; }
 bool Object::is_light_source() const { return material -> is_light_source; }
+double Object::light_power() const { return is_light_source() ? material -> average_emittance() * area : 0; }
 
 vec3 Object::eval(const Hit& hit, const vec3& outgoing_vector) const{
     vec3 UV = get_UV(hit.intersection_point);
     return material -> eval(hit, outgoing_vector, UV[0], UV[1]);
 }
 
-BrdfData Object::sample(const Hit& hit) const{
+BrdfData Object::sample(const Hit& hit, Sampler& sampler) const{
     vec3 UV = get_UV(hit.intersection_point);
-    return material -> sample(hit, UV[0], UV[1]);
+    return material -> sample(hit, UV[0], UV[1], sampler);
 }
 
 double Object::brdf_pdf(const vec3& outgoing_vector, const Hit& hit) const{
@@ -32,8 +36,9 @@ vec3 Object::get_light_emittance(const Hit& hit) const{
 }
 
 bool Object::find_closest_object_hit(Hit& hit, Ray& ray) const{ return false; }
+bool Object::find_any_object_hit(Hit& hit, Ray& ray) const{ return find_closest_object_hit(hit, ray); }
 vec3 Object::get_normal_vector(const vec3& surface_point, const int primitive_ID) const{ return vec3(); }
-vec3 Object::generate_random_surface_point() const{ return vec3(); }
+vec3 Object::generate_random_surface_point(Sampler& sampler) const{ return vec3(); }
 
 double Object::area_to_angle_PDF_factor(const vec3& surface_point, const vec3& intersection_point, const int primitive_ID) const{
     vec3 normal_vector = get_normal_vector(surface_point, primitive_ID);
@@ -47,8 +52,8 @@ double Object::light_pdf(const vec3& surface_point, const vec3& intersection_poi
     return std::abs(1.0 / (area * area_to_angle_PDF_factor(surface_point, intersection_point, primitive_id)));
 }
 
-vec3 Object::random_light_point(const vec3& intersection_point, double& pdf) const{
-    vec3 random_point = generate_random_surface_point();
+vec3 Object::random_light_point(const vec3& intersection_point, double& pdf, Sampler& sampler) const{
+    vec3 random_point = generate_random_surface_point(sampler);
     pdf = light_pdf(random_point, intersection_point, 0);
     return random_point;
 }
@@ -69,6 +74,11 @@ Sphere::Sphere(const vec3& _position, const double _radius, Material*_material)
     area = 4 * M_PI * radius * radius;
 }
 
+primitive_type Sphere::get_primitive_type() const { return SPHERE_PRIMITIVE; }
+vec3 Sphere::max_axis_point() const { return position + vec3(radius); }
+vec3 Sphere::min_axis_point() const { return position - vec3(radius); }
+vec3 Sphere::compute_centroid() const { return position; }
+
 vec3 Sphere::get_UV(const vec3& point) const{
     vec3 unit_sphere_point = (point - position) / radius;
     double x = -unit_sphere_point[0];
@@ -80,13 +90,8 @@ vec3 Sphere::get_UV(const vec3& point) const{
 }
 
 bool Sphere::find_closest_object_hit(Hit& hit, Ray& ray) const {
-    double dot_product = dot_vectors(ray.direction_vector, ray.starting_position);
-    double b = 2 * (dot_product - dot_vectors(ray.direction_vector, position));
-    vec3 difference_in_positions = position - ray.starting_position;
-    double c = difference_in_positions.length_squared() - radius * radius;
     double distance;
-    bool success = solve_quadratic(b, c, distance);
-    if (!success || distance > ray.t_max){
+    if (!intersect_sphere(position, radius, ray, distance)){
         return false;
     }
     hit.primitive_ID = primitive_ID;
@@ -99,8 +104,8 @@ vec3 Sphere::get_normal_vector(const vec3& surface_point, const int primitive_ID
     return normalize_vector(difference_vector);
 }
 
-vec3 Sphere::generate_random_surface_point() const {
-    return sample_spherical() * radius + position;
+vec3 Sphere::generate_random_surface_point(Sampler& sampler) const {
+    return sample_spherical(sampler) * radius + position;
 }
 
 double Sphere::light_pdf(const vec3& surface_point, const vec3& intersection_point, const int primitive_id) const{
@@ -113,10 +118,10 @@ double Sphere::light_pdf(const vec3& surface_point, const vec3& intersection_poi
     return 1.0 / (2.0 * M_PI * (1 - (cos_theta_max)));
 }
 
-vec3 Sphere::random_light_point(const vec3& intersection_point, double& pdf) const {
+vec3 Sphere::random_light_point(const vec3& intersection_point, double& pdf, Sampler& sampler) const {
     double distance = (intersection_point - position).length();
     if (distance <= radius){
-        vec3 random_point = generate_random_surface_point();
+        vec3 random_point = generate_random_surface_point(sampler);
         pdf = light_pdf(random_point, intersection_point, 0);
         return random_point;
     }
@@ -124,7 +129,7 @@ vec3 Sphere::random_light_point(const vec3& intersection_point, double& pdf) con
     double cos_theta_max = sqrt(1 - pow(radius / distance, 2));
     pdf = light_pdf(vec3(0), intersection_point, 0);
 
-    double rand = random_uniform(0, 1);
+    double rand = sampler.random_uniform(0, 1);
     double cos_theta = 1 + rand * (cos_theta_max-1);
     double sin_theta = sqrt(1 - cos_theta * cos_theta);
     double cos_alpha = (radius * radius + distance * distance - pow(distance * cos_theta - sqrt(radius * radius - pow(distance*sin_theta, 2)), 2)) / (2.0 * distance * radius);
@@ -134,7 +139,7 @@ vec3 Sphere::random_light_point(const vec3& intersection_point, double& pdf) con
     vec3 y_hat;
     vec3 z_hat = get_normal_vector(intersection_point, 0);
     set_perpendicular_vectors(z_hat, x_hat, y_hat);
-    double phi = random_uniform(0, 2.0 * M_PI);
+    double phi = sampler.random_uniform(0, 2.0 * M_PI);
     vec3 random_point = x_hat * sin_alpha * cos(phi) + y_hat * sin_alpha * sin(phi) + z_hat * cos_alpha;
     return random_point * radius + position;
 }
@@ -149,6 +154,9 @@ Plane::Plane(const vec3& _position, const vec3& _v1, const vec3& _v2, Material*_
     normal_vector = normalize_vector(_normal_vector);
 }
 
+primitive_type Plane::get_primitive_type() const { return PLANE_PRIMITIVE; }
+bool Plane::is_bounded() const { return false; }
+
 vec3 Plane::get_UV(const vec3& point) const {
     vec3 shifted_point = point - position;
     double u = 1 - dot_vectors(shifted_point, v1) - 0.5;
@@ -156,27 +164,10 @@ vec3 Plane::get_UV(const vec3& point) const {
     return vec3(u, v, 0);
 }
 
-bool Plane::compute_distance_in_centered_system(const vec3& starting_point, const Ray& ray, double& distance) const {
-    double direction_dot_normal = -dot_vectors(ray.direction_vector, normal_vector);
-    if (std::abs(direction_dot_normal) < constants::EPSILON){
-        return false;
-    }
-
-    double distances_to_start = dot_vectors(starting_point, normal_vector);
-    distance = distances_to_start / direction_dot_normal;
-    if (distance < constants::EPSILON){
-        return false;
-    }
-    if (distance > ray.t_max){
-        return false;
-    }
-    return true;
-}
-
 bool Plane::find_closest_object_hit(Hit& hit, Ray& ray) const {
     vec3 shifted_point = ray.starting_position - position;
     double distance;
-    if (!compute_distance_in_centered_system(shifted_point, ray, distance)){
+    if (!intersect_plane(shifted_point, normal_vector, ray, distance)){
         return false;
     }
     hit.primitive_ID = primitive_ID;
@@ -199,6 +190,22 @@ Rectangle::Rectangle(const vec3& _position, const vec3& _v1, const vec3& _v2, co
     L2 = _L2;
     area = L1 * L2;
 }
+primitive_type Rectangle::get_primitive_type() const { return RECTANGLE_PRIMITIVE; }
+bool Rectangle::is_bounded() const { return true; }
+
+vec3 Rectangle::max_axis_point() const {
+    // Includes the tolerance used by the intersection test along both edges.
+    vec3 half_extent = abs(v1) * (L1 / 2.0 + constants::EPSILON) + abs(v2) * (L2 / 2.0 + constants::EPSILON);
+    return position + half_extent;
+}
+
+vec3 Rectangle::min_axis_point() const {
+    vec3 half_extent = abs(v1) * (L1 / 2.0 + constants::EPSILON) + abs(v2) * (L2 / 2.0 + constants::EPSILON);
+    return position - half_extent;
+}
+
+vec3 Rectangle::compute_centroid() const { return position; }
+
 vec3 Rectangle::get_UV(const vec3& point) const {
     vec3 shifted_point = point - position;
     double u = 1 - dot_vectors(shifted_point, v1) / L1 - 0.5;
@@ -207,17 +214,8 @@ vec3 Rectangle::get_UV(const vec3& point) const {
 }
 
 bool Rectangle::find_closest_object_hit(Hit& hit, Ray& ray) const {
-    vec3 shifted_point = ray.starting_position - position;
     double distance;
-    if (!compute_distance_in_centered_system(shifted_point, ray, distance)){
-        return false;
-    }
-    double direction_dot_v1 = dot_vectors(ray.direction_vector, v1);
-    double direction_dot_v2 = dot_vectors(ray.direction_vector, v2);
-    double start_dot_v1 = dot_vectors(shifted_point, v1);
-    double start_dot_v2 = dot_vectors(shifted_point, v2);
-
-    if (std::abs(start_dot_v1 + direction_dot_v1 * distance) > L1 / 2.0 + constants::EPSILON || std::abs(start_dot_v2 + direction_dot_v2 * distance) > L2 / 2.0 + constants::EPSILON){
+    if (!intersect_rectangle(position, v1, v2, normal_vector, L1, L2, ray, distance)){
         return false;
     }
     hit.distance = distance;
@@ -229,9 +227,9 @@ double Rectangle::light_pdf(const vec3& surface_point, const vec3& intersection_
     return std::abs(1.0 / (area * area_to_angle_PDF_factor(surface_point, intersection_point, primitive_id)));
 }
 
-vec3 Rectangle::generate_random_surface_point() const {
-    double r1 = random_uniform(-L1/2, L1/2);
-    double r2 = random_uniform(-L2/2, L2/2);
+vec3 Rectangle::generate_random_surface_point(Sampler& sampler) const {
+    double r1 = sampler.random_uniform(-L1/2, L1/2);
+    double r2 = sampler.random_uniform(-L2/2, L2/2);
     return v1 * r1 + v2 * r2 + position;
 }
 
@@ -269,6 +267,8 @@ Triangle::Triangle(const vec3& _p1, const vec3& _p2, const vec3& _p3, Material*_
     n3 = normal_vector;
 }
 
+primitive_type Triangle::get_primitive_type() const { return TRIANGLE_PRIMITIVE; }
+
 vec3 Triangle::max_axis_point() const {
     vec3 point;
     for (int i = 0; i < 3; i++){
@@ -329,9 +329,30 @@ vec3 Triangle::get_UV(const vec3& point) const {
 }
 
 bool Triangle::find_closest_object_hit(Hit& hit, Ray& ray) const {
-    vec3 p1t = p1 - ray.starting_position;
-    vec3 p2t = p2 - ray.starting_position;
-    vec3 p3t = p3 - ray.starting_position;
+    if (!intersect_triangle(p1, p2, p3, ray, hit.distance)){
+        return false;
+    }
+    hit.primitive_ID = primitive_ID;
+    return true;
+}
+
+vec3 Triangle::generate_random_surface_point(Sampler& sampler) const {
+    double r1 = sampler.random_uniform(0, 1);
+    double r2 = sampler.random_uniform(0, 1);
+    return p1 * (1.0 - sqrt(r1)) + p2 * (sqrt(r1) * (1.0 - r2)) + p3 * (sqrt(r1) * r2);
+}
+
+
+template <class T>
+bool intersect_triangle(const vec3_t<T>& p1, const vec3_t<T>& p2, const vec3_t<T>& p3, const Ray& ray, double& distance){
+    // Watertight ray-triangle test, so rays never slip through the shared edges of neighbouring triangles. The vertices
+    // are moved to the ray origin in double, so nothing is lost to rounding close to the origin. Whether the triangle is
+    // hit is decided by edge functions in T, redone in double when one is exactly zero, as single precision cannot tell
+    // which side of an edge the ray passes then. The distance is always computed in double, so hit points are equally
+    // accurate in both precisions.
+    vec3 p1t = vec3(p1) - ray.starting_position;
+    vec3 p2t = vec3(p2) - ray.starting_position;
+    vec3 p3t = vec3(p3) - ray.starting_position;
 
     p1t = permute(p1t, ray.kx, ray.ky, ray.kz);
     p2t = permute(p2t, ray.kx, ray.ky, ray.kz);
@@ -344,9 +365,15 @@ bool Triangle::find_closest_object_hit(Hit& hit, Ray& ray) const {
     p3t[0] += ray.Sx * p3t[2];
     p3t[1] += ray.Sy * p3t[2];
 
-    double e1 = p2t[0] * p3t[1] - p2t[1] * p3t[0];
-    double e2 = p3t[0] * p1t[1] - p3t[1] * p1t[0];
-    double e3 = p1t[0] * p2t[1] - p1t[1] * p2t[0];
+    double e1 = T(p2t[0]) * T(p3t[1]) - T(p2t[1]) * T(p3t[0]);
+    double e2 = T(p3t[0]) * T(p1t[1]) - T(p3t[1]) * T(p1t[0]);
+    double e3 = T(p1t[0]) * T(p2t[1]) - T(p1t[1]) * T(p2t[0]);
+
+    if (sizeof(T) < sizeof(double) && (e1 == 0 || e2 == 0 || e3 == 0)){
+        e1 = p2t[0] * p3t[1] - p2t[1] * p3t[0];
+        e2 = p3t[0] * p1t[1] - p3t[1] * p1t[0];
+        e3 = p1t[0] * p2t[1] - p1t[1] * p2t[0];
+    }
 
     if ((e1 < 0 || e2 < 0 || e3 < 0) && (e1 > 0 || e2 > 0 || e3 > 0)){
         return false;
@@ -370,17 +397,12 @@ bool Triangle::find_closest_object_hit(Hit& hit, Ray& ray) const {
         return false;
     }
 
-    hit.distance = t_scaled / det;
-
-    hit.primitive_ID = primitive_ID;
+    distance = t_scaled / det;
     return true;
 }
 
-vec3 Triangle::generate_random_surface_point() const {
-    double r1 = random_uniform(0, 1);
-    double r2 = random_uniform(0, 1);
-    return p1 * (1.0 - sqrt(r1)) + p2 * (sqrt(r1) * (1.0 - r2)) + p3 * (sqrt(r1) * r2);
-}
+template bool intersect_triangle<double>(const vec3& p1, const vec3& p2, const vec3& p3, const Ray& ray, double& distance);
+template bool intersect_triangle<float>(const vec3f& p1, const vec3f& p2, const vec3f& p3, const Ray& ray, double& distance);
 
 
 bool find_closest_hit(Hit& closest_hit, Ray& ray, Object** objects, const int number_of_objects){
@@ -403,34 +425,19 @@ bool find_closest_hit(Hit& closest_hit, Ray& ray, Object** objects, const int nu
         return false;
     }
 
-    closest_hit.intersection_point = ray.starting_position + ray.direction_vector * closest_hit.distance;
-    vec3 normal_vector = objects[closest_hit.intersected_object_index] -> get_normal_vector(closest_hit.intersection_point, closest_hit.primitive_ID);
-    // TODO: add normal_out_from_interface - maybe even replace normal_vector if that is fine...
-    closest_hit.outside = dot_vectors(ray.direction_vector, normal_vector) < 0;
-    closest_hit.normal_vector = closest_hit.outside ? normal_vector : -normal_vector;
-    closest_hit.incident_vector = ray.direction_vector;
+    complete_hit(closest_hit, ray, objects);
     return true;
  }
 
 
-int sample_random_light(Object** objects, const int number_of_objects, int& number_of_light_sources){
-    int light_source_idx_array[number_of_objects];
-
-    number_of_light_sources = 0;
-
-    for (int i = 0; i < number_of_objects; i++){
-        if (objects[i] -> is_light_source()){
-            light_source_idx_array[number_of_light_sources] = i;
-            number_of_light_sources++;
-        }
-    }
-    if (number_of_light_sources == 0){
-        return -1;
-    }
-
-    int random_index = random_int(0, number_of_light_sources);
-    int light_index = light_source_idx_array[random_index];
-    return light_index;
+void complete_hit(Hit& hit, const Ray& ray, Object** objects){
+    // Fills in the parts of the closest hit that are only needed once it is known.
+    hit.intersection_point = ray.starting_position + ray.direction_vector * hit.distance;
+    vec3 normal_vector = objects[hit.intersected_object_index] -> get_normal_vector(hit.intersection_point, hit.primitive_ID);
+    // TODO: add normal_out_from_interface - maybe even replace normal_vector if that is fine...
+    hit.outside = dot_vectors(ray.direction_vector, normal_vector) < 0;
+    hit.normal_vector = hit.outside ? normal_vector : -normal_vector;
+    hit.incident_vector = ray.direction_vector;
 }
 
 
@@ -441,21 +448,61 @@ double mis_weight(const int n_a, const double pdf_a, const int n_b, const double
 }
 
 
-vec3 compute_visibility(const vec3& point, Object** objects, const int number_of_objects, const MediumStack& current_medium_stack, const int light_index, vec3& sampled_direction, vec3& transmittance, double& distance){
+vec3 compute_visibility(const vec3& point, const SceneGeometry& geometry, const MediumStack& current_medium_stack, const int light_index, vec3& sampled_direction, vec3& transmittance, double& distance){
     // TODO: Rename this function. This is the function used for the part that uses MIS?
-    MediumStack new_medium_stack = MediumStack(current_medium_stack.get_array(), current_medium_stack.get_stack_size());
+    Object** objects = geometry.objects;
     Ray ray;
     ray.starting_position = point;
     ray.direction_vector = sampled_direction;
     transmittance = vec3(1);
     vec3 light_emittance = vec3(0);
-
     distance = 0;
+
+    // Finds where the ray meets the light, then only asks whether anything blocks the segment before it. The ray is
+    // followed hit by hit below only when it crosses surfaces that let direct light through. The environment lies at
+    // infinite distance, so for it nothing at all may be in the way.
+    bool is_environment = light_index == environment_light_index;
+    ray.prepare();
+    Hit light_hit;
+    if (is_environment){
+        light_hit.distance = constants::max_ray_distance;
+    }
+    else if (!objects[light_index] -> find_closest_object_hit(light_hit, ray) || light_hit.distance <= constants::EPSILON){
+        return vec3(0);
+    }
+    ray.t_max = light_hit.distance;
+    bool crosses_transparent_surface;
+    if (geometry.is_occluded(ray, crosses_transparent_surface)){
+        return vec3(0);
+    }
+    if (!crosses_transparent_surface){
+        distance = light_hit.distance;
+        Medium* medium = current_medium_stack.get_medium();
+        if (medium){
+            transmittance *= medium -> transmittance_albedo(light_hit.distance);
+        }
+        if (is_environment){
+            return geometry.environment -> radiance(ray.direction_vector);
+        }
+        light_hit.intersected_object_index = light_index;
+        complete_hit(light_hit, ray, objects);
+        return objects[light_index] -> get_light_emittance(light_hit);
+    }
+
+    MediumStack new_medium_stack = current_medium_stack;
     while (true){
         ray.t_max = constants::max_ray_distance;
         Hit light_hit;
-        if (!find_closest_hit(light_hit, ray, objects, number_of_objects)){
-            return vec3(0);
+        if (!geometry.find_closest_hit(light_hit, ray)){
+            if (!is_environment){
+                return vec3(0);
+            }
+            distance = constants::max_ray_distance;
+            Medium* medium = new_medium_stack.get_medium();
+            if (medium){
+                transmittance *= medium -> transmittance_albedo(distance);
+            }
+            return geometry.environment -> radiance(ray.direction_vector);
         }
         distance += light_hit.distance;
         Medium* medium = new_medium_stack.get_medium();
@@ -484,26 +531,35 @@ vec3 compute_visibility(const vec3& point, Object** objects, const int number_of
 }
 
 
-vec3 sample_light(const Hit& hit, Object** objects, const int number_of_objects, const MediumStack& current_medium_stack, const bool is_scatter){
-    vec3 L = vec3(0);
+LightSample prepare_light_sample(const Hit& hit, const SceneGeometry& geometry, const MediumStack& current_medium_stack, const bool is_scatter, Sampler& sampler){
+    // Draws a point on a random light and computes everything except its visibility, so the shadow ray can be traced later.
+    LightSample light_sample;
+    Object** objects = geometry.objects;
     // TODO: rename is_scatter
 
-    int number_of_light_sources;
-    int light_index = sample_random_light(objects, number_of_objects, number_of_light_sources);
+    double selection_pdf;
+    int light_index = geometry.sample_light_source(sampler, selection_pdf);
     if (light_index == -1 || light_index == hit.intersected_object_index){
-        return L;
+        return light_sample;
     }
 
     double light_pdf;
-    vec3 random_point = objects[light_index] -> random_light_point(hit.intersection_point, light_pdf);
+    vec3 sampled_direction;
+    double distance_to_light;
+    if (light_index == environment_light_index){
+        sampled_direction = geometry.environment -> sample_direction(sampler, light_pdf);
+        distance_to_light = constants::max_ray_distance;
+    }
+    else{
+        vec3 random_point = objects[light_index] -> random_light_point(hit.intersection_point, light_pdf, sampler);
+        sampled_direction = random_point - hit.intersection_point;
+        distance_to_light = sampled_direction.length();
+        sampled_direction = normalize_vector(sampled_direction);
+    }
     if (light_pdf == 0){
-        return L;
+        return light_sample;
     }
 
-    vec3 sampled_direction = random_point - hit.intersection_point;
-    double distance_to_light = sampled_direction.length();
-    sampled_direction = normalize_vector(sampled_direction);
-
     Medium* current_medium = current_medium_stack.get_medium();
 
     vec3 brdf;
@@ -511,7 +567,7 @@ vec3 sample_light(const Hit& hit, Object** objects, const int number_of_objects,
         brdf = objects[hit.intersected_object_index] -> eval(hit, sampled_direction);
 
         if (brdf.length_squared() == 0){
-            return L;
+            return light_sample;
         }
     }
 
@@ -523,28 +579,56 @@ vec3 sample_light(const Hit& hit, Object** objects, const int number_of_objects,
         scatter_pdf = objects[hit.intersected_object_index] -> brdf_pdf(sampled_direction, hit);
     }
 
-    double distance;
-    vec3 transmittance;
-    vec3 emittance = compute_visibility(hit.intersection_point, objects, number_of_objects, current_medium_stack, light_index, sampled_direction, transmittance, distance);
-
-    if (std::abs(distance_to_light - distance) > constants::EPSILON || emittance.length_squared() == 0){
-        return L;
-    }
-
-    double weight = mis_weight(1, light_pdf, 1, scatter_pdf);
+    double weight = mis_weight(1, selection_pdf * light_pdf, 1, scatter_pdf);
     if (is_scatter){
-        L = weight * scatter_pdf * emittance * transmittance / light_pdf;
+        light_sample.factor = vec3(weight * scatter_pdf);
     }
     else{
         bool wrong_side = (dot_vectors(hit.incident_vector, hit.normal_vector) * dot_vectors(sampled_direction, hit.normal_vector)) > 0 ;
         if (wrong_side){
-            return L;
+            return light_sample;
         }
         double cosine = std::max(dot_vectors(hit.normal_vector, sampled_direction), 0.0); // TODO: used to be abs here, but I did not like that - but test!
-        L = weight * brdf * cosine * emittance * transmittance / light_pdf;
+        light_sample.factor = weight * brdf * cosine;
     }
 
-    L *= (double) number_of_light_sources;
+    light_sample.valid = true;
+    light_sample.light_index = light_index;
+    light_sample.point = hit.intersection_point;
+    light_sample.direction = sampled_direction;
+    light_sample.distance_to_light = distance_to_light;
+    light_sample.pdf = light_pdf;
+    light_sample.selection_pdf = selection_pdf;
+    return light_sample;
+}
+
+
+vec3 evaluate_light_sample(const LightSample& light_sample, const SceneGeometry& geometry, const MediumStack& current_medium_stack){
+    vec3 L = vec3(0);
+    if (!light_sample.valid){
+        return L;
+    }
+
+    double distance;
+    vec3 transmittance;
+    vec3 sampled_direction = light_sample.direction;
+    vec3 emittance = compute_visibility(light_sample.point, geometry, current_medium_stack, light_sample.light_index, sampled_direction, transmittance, distance);
+
+    if (emittance.length_squared() == 0){
+        return L;
+    }
+    if (light_sample.light_index != environment_light_index && std::abs(light_sample.distance_to_light - distance) > constants::EPSILON){
+        return L;
+    }
+
+    L = light_sample.factor * emittance * transmittance / light_sample.pdf;
+    L /= light_sample.selection_pdf;
 
     return L;
 }
+
+
+vec3 sample_light(const Hit& hit, const SceneGeometry& geometry, const MediumStack& current_medium_stack, const bool is_scatter, Sampler& sampler){
+    LightSample light_sample = prepare_light_sample(hit, geometry, current_medium_stack, is_scatter, sampler);
+    return evaluate_light_sample(light_sample, geometry, current_medium_stack);
+}
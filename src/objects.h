@@ -13,6 +13,18 @@ struct BrdfData;
 
 class MediumStack;
 
+class SceneGeometry;
+
+enum primitive_type{
+    // Lets SceneGeometry store the simple shapes in arrays of their own type and dispatch on the tag instead of through
+    // virtual calls. Everything else is GENERIC and keeps using the Object interface.
+    GENERIC_PRIMITIVE = 0,
+    SPHERE_PRIMITIVE = 1,
+    PLANE_PRIMITIVE = 2,
+    RECTANGLE_PRIMITIVE = 3,
+    TRIANGLE_PRIMITIVE = 4
+};
+
 class Object{
     public:
         Material* material;
@@ -20,24 +32,29 @@ class Object{
         int primitive_ID; // Used when object belongs to an ObjectUnion.
         Object(){}
         Object(Material* _material);
+        virtual ~Object(){}
 
+        virtual primitive_type get_primitive_type() const;
+        virtual bool is_bounded() const;
         virtual vec3 max_axis_point() const;
         virtual vec3 min_axis_point() const;
         virtual vec3 compute_centroid() const;
         virtual vec3 get_UV(const vec3& point) const;
         virtual Material* get_material(const int primitive_ID) const;
         virtual bool is_light_source() const;
+        virtual double light_power() const;
         virtual vec3 eval(const Hit& hit, const vec3& outgoing_vector) const;
         vec3 sample_direct(const Hit& hit, Object** objects, const int number_of_objects, const MediumStack& current_medium_stack) const;
-        virtual BrdfData sample(const Hit& hit) const;
+        virtual BrdfData sample(const Hit& hit, Sampler& sampler) const;
         virtual double brdf_pdf(const vec3& outgoing_vector, const Hit& hit) const;
         virtual vec3 get_light_emittance(const Hit& hit) const;
         virtual bool find_closest_object_hit(Hit& hit, Ray& ray) const;
+        virtual bool find_any_object_hit(Hit& hit, Ray& ray) const;
         virtual vec3 get_normal_vector(const vec3& surface_point, const int primitive_ID) const;
-        virtual vec3 generate_random_surface_point() const;
+        virtual vec3 generate_random_surface_point(Sampler& sampler) const;
         double area_to_angle_PDF_factor(const vec3& surface_point, const vec3& intersection_point, const int primitive_ID) const;
         virtual double light_pdf(const vec3& surface_point, const vec3& intersection_point, const int primitive_id) const;
-        virtual vec3 random_light_point(const vec3& intersection_point, double& inverse_PDF) const;
+        virtual vec3 random_light_point(const vec3& intersection_point, double& inverse_PDF, Sampler& sampler) const;
 };
 
 
@@ -47,14 +64,19 @@ class Sphere: public Object{
         Sphere(const vec3& _position, const double _radius);
         Sphere(const vec3& _position, const double _radius, Material*_material);
 
+        primitive_type get_primitive_type() const override;
+        vec3 max_axis_point() const override;
+        vec3 min_axis_point() const override;
+        vec3 compute_centroid() const override;
         vec3 get_UV(const vec3& point) const override;
         bool find_closest_object_hit(Hit& hit, Ray& ray) const override;
         vec3 get_normal_vector(const vec3& surface_point, const int primitive_ID) const override;
-        vec3 generate_random_surface_point() const override;
+        vec3 generate_random_surface_point(Sampler& sampler) const override;
         double light_pdf(const vec3& surface_point, const vec3& intersection_point, const int primitive_id) const override;
-        vec3 random_light_point(const vec3& intersection_point, double& inverse_PDF) const override;
+        vec3 random_light_point(const vec3& intersection_point, double& inverse_PDF, Sampler& sampler) const override;
 
     private:
+        friend class SceneGeometry;
         vec3 position;
         double radius;
 };
@@ -65,13 +87,15 @@ class Plane: public Object{
         Plane(){}
         Plane(const vec3& _position, const vec3& _v1, const vec3& _v2, Material*_material);
 
+        primitive_type get_primitive_type() const override;
+        bool is_bounded() const override;
         vec3 get_UV(const vec3& point) const override;
-        bool compute_distance_in_centered_system(const vec3& starting_point, const Ray& ray, double& distance) const;
         bool find_closest_object_hit(Hit& hit, Ray& ray) const override;
         vec3 get_normal_vector(const vec3& surface_point, const int primitive_ID) const override;
         double light_pdf(const vec3& surface_point, const vec3& intersection_point, const int primitive_id) const override;
 
     protected:
+        friend class SceneGeometry;
         vec3 position;
         vec3 v1;
         vec3 v2;
@@ -84,12 +108,18 @@ class Rectangle: public Plane{
         Rectangle(){}
         Rectangle(const vec3& _position, const vec3& _v1, const vec3& _v2, const double _L1, const double _L2, Material*_material);
 
+        primitive_type get_primitive_type() const override;
+        bool is_bounded() const override;
+        vec3 max_axis_point() const override;
+        vec3 min_axis_point() const override;
+        vec3 compute_centroid() const override;
         vec3 get_UV(const vec3& point) const override;
         bool find_closest_object_hit(Hit& hit, Ray& ray) const override;
         double light_pdf(const vec3& surface_point, const vec3& intersection_point, const int primitive_id) const override;
-        vec3 generate_random_surface_point() const override;
+        vec3 generate_random_surface_point(Sampler& sampler) const override;
 
     private:
+        friend class SceneGeometry;
         double L1;
         double L2;
 };
@@ -100,6 +130,7 @@ class Triangle: public Object{
         Triangle(){}
         Triangle(const vec3& _p1, const vec3& _p2, const vec3& _p3, Material*_material);
 
+        primitive_type get_primitive_type() const override;
         vec3 max_axis_point() const override;
         vec3 min_axis_point() const override;
         vec3 compute_centroid() const override;
@@ -110,9 +141,10 @@ class Triangle: public Object{
         vec3 compute_barycentric(const vec3& point) const;
         vec3 get_UV(const vec3& point) const override;
         bool find_closest_object_hit(Hit& hit, Ray& ray) const override;
-        vec3 generate_random_surface_point() const override;
+        vec3 generate_random_surface_point(Sampler& sampler) const override;
 
     private:
+        friend class SceneGeometry;
         vec3 position;
         vec3 normal_vector;
         vec3 p1;
@@ -139,12 +171,62 @@ class Triangle: public Object{
 };
 
 
+struct LightSample{
+    bool valid = false;
+    int light_index = -1;
+    vec3 point;
+    vec3 direction;
+    double distance_to_light;
+    double pdf;
+    vec3 factor; // MIS weight times the BRDF and cosine, or times the phase function in a medium.
+    double selection_pdf; // Probability of having picked this light among all light sources.
+};
+
+
+// Intersection tests shared by the shape classes and the type-sorted arrays of SceneGeometry. They are inline so that
+// the latter can test a primitive without any call.
+inline bool intersect_sphere(const vec3& position, const double radius, const Ray& ray, double& distance){
+    double dot_product = dot_vectors(ray.direction_vector, ray.starting_position);
+    double b = 2 * (dot_product - dot_vectors(ray.direction_vector, position));
+    vec3 difference_in_positions = position - ray.starting_position;
+    double c = difference_in_positions.length_squared() - radius * radius;
+    return solve_quadratic(b, c, distance) && distance <= ray.t_max;
+}
+
+inline bool intersect_plane(const vec3& shifted_start, const vec3& normal_vector, const Ray& ray, double& distance){
+    // shifted_start is the ray origin relative to a point on the plane.
+    double direction_dot_normal = -dot_vectors(ray.direction_vector, normal_vector);
+    if (std::abs(direction_dot_normal) < constants::EPSILON){
+        return false;
+    }
+
+    double distances_to_start = dot_vectors(shifted_start, normal_vector);
+    distance = distances_to_start / direction_dot_normal;
+    return distance >= constants::EPSILON && distance <= ray.t_max;
+}
+
+inline bool intersect_rectangle(const vec3& position, const vec3& v1, const vec3& v2, const vec3& normal_vector, const double L1, const double L2, const Ray& ray, double& distance){
+    vec3 shifted_point = ray.starting_position - position;
+    if (!intersect_plane(shifted_point, normal_vector, ray, distance)){
+        return false;
+    }
+    double direction_dot_v1 = dot_vectors(ray.direction_vector, v1);
+    double direction_dot_v2 = dot_vectors(ray.direction_vector, v2);
+    double start_dot_v1 = dot_vectors(shifted_point, v1);
+    double start_dot_v2 = dot_vectors(shifted_point, v2);
+    return std::abs(start_dot_v1 + direction_dot_v1 * distance) <= L1 / 2.0 + constants::EPSILON && std::abs(start_dot_v2 + direction_dot_v2 * distance) <= L2 / 2.0 + constants::EPSILON;
+}
+
+template <class T>
+bool intersect_triangle(const vec3_t<T>& p1, const vec3_t<T>& p2, const vec3_t<T>& p3, const Ray& ray, double& distance);
 bool find_closest_hit(Hit& closest_hit, Ray& ray, Object** objects, const int number_of_objects);
-int sample_random_light(Object** objects, const int number_of_objects, int& number_of_light_sources);
+void complete_hit(Hit& hit, const Ray& ray, Object** objects);
 
 vec3 direct_lighting(const vec3& point, Object** objects, const int number_of_objects, vec3& sampled_direction, const MediumStack& current_medium_stack);
 double mis_weight(const int n_a, const double pdf_a, const int n_b, const double pdf_b);
-vec3 sample_light(const Hit& hit, Object** objects, const int number_of_objects, const MediumStack& current_medium_stack, const bool is_scatter);
+LightSample prepare_light_sample(const Hit& hit, const SceneGeometry& geometry, const MediumStack& current_medium_stack, const bool is_scatter, Sampler& sampler);
+vec3 evaluate_light_sample(const LightSample& light_sample, const SceneGeometry& geometry, const MediumStack& current_medium_stack);
+vec3 sample_light(const Hit& hit, const SceneGeometry& geometry, const MediumStack& current_medium_stack, const bool is_scatter, Sampler& sampler);
 
 
 #endif
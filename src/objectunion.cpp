@@ -5,40 +5,47 @@ ObjectUnion::ObjectUnion(Object** _objects, const int _number_of_objects, const
     objects = _objects;
     number_of_objects = _number_of_objects;
 
-    area = 0;
-    for (int i = 0; i < number_of_objects; i++){
-        area += objects[i] -> area;
-        if (objects[i] -> is_light_source()){
-            number_of_light_sources++;
+    // The BVH reorders the objects, so it is built before anything refers to them by index.
+    use_BVH = construct_BVH;
+    if (construct_BVH){
+        std::vector<BVH::BuildPrimitive> build_primitives = BVH::compute_build_primitives(objects, number_of_objects);
+        bvh = BVH::BoundingVolumeHierarchy<geometry_scalar>(build_primitives);
+        std::vector<Object*> ordered_objects(number_of_objects);
+        for (int i = 0; i < number_of_objects; i++){
+            ordered_objects[i] = objects[build_primitives[i].index];
         }
+        std::copy(ordered_objects.begin(), ordered_objects.end(), objects);
     }
 
-    cumulative_area = new double[number_of_objects];
-    light_source_conversion_indices = new int[number_of_light_sources];
-    int j = 0;
+    bounds_min = vec3(constants::max_ray_distance);
+    bounds_max = vec3(-constants::max_ray_distance);
     for (int i = 0; i < number_of_objects; i++){
-        if (!objects[i] -> is_light_source()){
-            continue;
+        vec3 object_min = objects[i] -> min_axis_point();
+        vec3 object_max = objects[i] -> max_axis_point();
+        for (int j = 0; j < 3; j++){
+            bounds_min.e[j] = std::min(bounds_min[j], object_min[j]);
+            bounds_max.e[j] = std::max(bounds_max[j], object_max[j]);
         }
-        cumulative_area[j] = objects[i] -> area;
-        if (j != 0){
-            cumulative_area[j] += cumulative_area[j-1];
-        }
-        light_source_conversion_indices[j] = i;
-        j++;
     }
 
-    use_BVH = construct_BVH;
-    if (construct_BVH){
-        bvh = BVH::BoundingVolumeHierarchy(_objects, _number_of_objects, 6);
+    area = 0;
+    for (int i = 0; i < number_of_objects; i++){
+        area += objects[i] -> area;
     }
 
+    // Emissive objects are drawn by power, and a point on them uniformly by area.
+    std::vector<double> light_powers;
+    light_source_slots.assign(number_of_objects, -1);
     for (int i = 0; i < number_of_objects; i++){
         objects[i] -> primitive_ID = i;
         if (objects[i] -> is_light_source()){
-            contains_light_source = true;
+            light_source_slots[i] = light_source_indices.size();
+            light_source_indices.push_back(i);
+            light_powers.push_back(objects[i] -> light_power());
         }
     }
+    light_distribution = AliasTable(light_powers);
+    contains_light_source = !light_source_indices.empty();
 }
 
 ObjectUnion::~ObjectUnion(){
@@ -46,10 +53,12 @@ ObjectUnion::~ObjectUnion(){
         delete objects[i];
     }
     delete[] objects;
-    delete[] cumulative_area;
-    delete[] light_source_conversion_indices;
 }
 
+vec3 ObjectUnion::max_axis_point() const { return bounds_max; }
+vec3 ObjectUnion::min_axis_point() const { return bounds_min; }
+vec3 ObjectUnion::compute_centroid() const { return (bounds_min + bounds_max) / 2.0; }
+
 Material* ObjectUnion::get_material(const int primitive_ID) const {
     return objects[primitive_ID] -> material;
 }
@@ -58,12 +67,20 @@ bool ObjectUnion::is_light_source() const {
     return contains_light_source;
 }
 
+double ObjectUnion::light_power() const {
+    double power = 0;
+    for (int i = 0; i < number_of_objects; i++){
+        power += objects[i] -> light_power();
+    }
+    return power;
+}
+
 vec3 ObjectUnion::eval(const Hit& hit, const vec3& outgoing_vector) const {
     return objects[hit.primitive_ID]  -> eval(hit, outgoing_vector);
 }
 
-BrdfData ObjectUnion::sample(const Hit& hit) const {
-    return objects[hit.primitive_ID] -> sample(hit);
+BrdfData ObjectUnion::sample(const Hit& hit, Sampler& sampler) const {
+    return objects[hit.primitive_ID] -> sample(hit, sampler);
 }
 
 double ObjectUnion::brdf_pdf(const vec3& outgoing_vector, const Hit& hit) const{
@@ -76,7 +93,17 @@ vec3 ObjectUnion::get_light_emittance(const Hit& hit) const {
 
 bool ObjectUnion::find_closest_object_hit(Hit& hit, Ray& ray) const {
     if (use_BVH){
-        return bvh.intersect(hit, ray);
+        return bvh.intersect(ray, [this, &hit](const int i, Ray& ray){
+            Hit primitive_hit;
+            bool success = objects[i] -> find_closest_object_hit(primitive_hit, ray);
+            if (success && primitive_hit.distance > constants::EPSILON && primitive_hit.distance < hit.distance){
+                hit.distance = primitive_hit.distance;
+                hit.primitive_ID = primitive_hit.primitive_ID;
+                ray.t_max = primitive_hit.distance;
+                return true;
+            }
+            return false;
+        });
     }
 
     bool success = find_closest_hit(hit, ray, objects, number_of_objects);
@@ -89,305 +116,26 @@ vec3 ObjectUnion::get_normal_vector(const vec3& surface_point, const int primiti
     return objects[primitive_ID] -> get_normal_vector(surface_point, primitive_ID);
 }
 
-int ObjectUnion::sample_random_primitive_index() const{
-    double random_area_split = random_uniform(0, area);
-    int max = number_of_light_sources - 1;
-    int min = 0;
-    int index;
-
-    if (cumulative_area[0] >= random_area_split){
-        return light_source_conversion_indices[0];
-    }
-
-    while (min <= max){
-        index = (max - min) / 2 + min;
-
-        if (cumulative_area[index] < random_area_split){
-            min = index + 1;
-        }
-        else if (cumulative_area[index] == random_area_split || (cumulative_area[index] >= random_area_split && cumulative_area[index-1] < random_area_split)){
-            break;
-        }
-        else{
-            max = index - 1;
-        }
-    }
-
-    return light_source_conversion_indices[index];
+int ObjectUnion::sample_random_primitive_index(Sampler& sampler) const{
+    double pdf;
+    return light_source_indices[light_distribution.sample(sampler, pdf)];
 }
 
-vec3 ObjectUnion::generate_random_surface_point() const {
-    return objects[sample_random_primitive_index()] -> generate_random_surface_point();
+vec3 ObjectUnion::generate_random_surface_point(Sampler& sampler) const {
+    return objects[sample_random_primitive_index(sampler)] -> generate_random_surface_point(sampler);
 }
 
 double ObjectUnion::light_pdf(const vec3& surface_point, const vec3& intersection_point, const int primitive_id) const{
-    return 1.0 / (cumulative_area[number_of_light_sources-1] * area_to_angle_PDF_factor(surface_point, intersection_point, primitive_id));
+    int slot = light_source_slots[primitive_id];
+    if (slot == -1){
+        return 0;
+    }
+    return std::abs(light_distribution.pdf(slot) / (objects[primitive_id] -> area * area_to_angle_PDF_factor(surface_point, intersection_point, primitive_id)));
 }
 
-vec3 ObjectUnion::random_light_point(const vec3& intersection_point, double& pdf) const{
-    int random_index = sample_random_primitive_index();
-    vec3 random_point = objects[random_index] -> generate_random_surface_point();
+vec3 ObjectUnion::random_light_point(const vec3& intersection_point, double& pdf, Sampler& sampler) const{
+    int random_index = sample_random_primitive_index(sampler);
+    vec3 random_point = objects[random_index] -> generate_random_surface_point(sampler);
     pdf = light_pdf(random_point, intersection_point, random_index);
     return random_point;
 }
-
-
-int number_of_char_occurances(const std::string& line, const char character){
-    int count = 0;
-    for (int i = 0; i < line.length(); i++){
-        if (line[i] == character){
-            count++;
-        }
-    }
-    return count;
-}
-
-
-std::string get_nth_word(const std::string& line, const char delimiter, const int n){
-    int number_of_words = number_of_char_occurances(line, delimiter);
-
-    if (n > number_of_words){
-        return "";
-    }
-
-    int start = 0;
-    int end = 0;
-    for (int i = 0; i < n+1; i++){
-        start = end;
-        end = line.find(delimiter, start)+1;
-    }
-    return line.substr(start, end - start - 1);
-}
-
-
-DataSizes get_vertex_data_sizes(const std::string& file_name){
-    std::ifstream model_file(file_name);
-    std::string line;
-    DataSizes nums;
-
-    while(std::getline(model_file, line)){
-        std::string first_word = get_nth_word(line, ' ', 0);
-
-        bool is_vertex = first_word == "v";
-        bool is_vertex_UV = first_word == "vt";
-        bool is_vertex_normal = first_word == "vn";
-        bool is_shape = first_word == "f";
-
-        if (is_vertex){
-            nums.num_vertices++;
-        }
-        else if (is_vertex_UV){
-            nums.num_vertex_UVs++;
-        }
-        else if (is_vertex_normal){
-            nums.num_vertex_normals++;
-        }
-        else if (is_shape){
-            int number_of_spaces = 0;
-            for (int i = 0; i < line.size(); i++){
-                if (line.substr(i, 1) == " "){
-                    number_of_spaces++;
-                }
-            }
-
-            bool is_triangle = number_of_spaces == 3;
-            bool is_quad = number_of_spaces == 4;
-            if (is_triangle){
-                nums.num_triangles++;
-            }
-
-            else if (is_quad){
-                nums.num_triangles += 2;
-            }
-        }
-    }
-    return nums;
-}
-
-
-void populate_vertex_arrays(const std::string& file_name, vec3* vertex_array, vec3* vertex_UV_array, vec3* vertex_normal_array){
-    int vertex_idx = 0;
-    int vertex_UV_idx = 0;
-    int vertex_normal_idx = 0;
-
-    std::ifstream model_file(file_name);
-    std::string line;
-    while(std::getline(model_file, line)){
-        std::string first_word = get_nth_word(line, ' ', 0);
-        bool is_vertex = first_word == "v";
-        bool is_vertex_UV = first_word == "vt";
-        bool is_vertex_normal = first_word == "vn";
-
-        if (is_vertex){
-            double v1 = std::stod(get_nth_word(line, ' ', 1));
-            double v2 = std::stod(get_nth_word(line, ' ', 2));
-            double v3 = std::stod(get_nth_word(line, ' ', 3));
-            vertex_array[vertex_idx] = vec3(v1, v2, v3);
-            vertex_idx++;
-        }
-        else if (is_vertex_UV){
-            double u = std::stod(get_nth_word(line, ' ', 1));
-            double v = std::stod(get_nth_word(line, ' ', 2));
-            vertex_UV_array[vertex_UV_idx] = vec3(u, v, 0);
-            vertex_UV_idx++;
-        }
-        else if (is_vertex_normal){
-            double n1 = std::stod(get_nth_word(line, ' ', 1));
-            double n2 = std::stod(get_nth_word(line, ' ', 2));
-            double n3 = std::stod(get_nth_word(line, ' ', 3));
-            vertex_normal_array[vertex_normal_idx] = vec3(n1, n2, n3);
-            vertex_normal_idx++;
-        }
-    }
-}
-
-
-vec3 compute_average_position(const vec3* vertex_array, const int number_of_vertices){
-    vec3 avg = vec3(0,0,0);
-    for (int i = 0; i < number_of_vertices; i++){
-        avg += vertex_array[i];
-    }
-    return avg / number_of_vertices;
-}
-
-
-double maximum_distance(const vec3& center, const vec3* vertex_array, const int number_of_vertices){
-    double max_distance = 0;
-    for (int i = 0; i < number_of_vertices; i++){
-        double distance = (vertex_array[i] - center).length();
-        if (distance > max_distance){
-            max_distance = distance;
-        }
-    }
-    return max_distance;
-}
-
-void change_vectors(const vec3& desired_center, const double desired_size, vec3* vertex_array, const int number_of_vertices){
-    vec3 average_position = compute_average_position(vertex_array, number_of_vertices);
-    double max_distance = maximum_distance(average_position, vertex_array, number_of_vertices);
-
-    for (int i = 0; i < number_of_vertices; i++){
-        vertex_array[i] = ((vertex_array[i] - average_position) / max_distance) * desired_size + desired_center;
-    }
-}
-
-
-void populate_vertex_vectors(PopulateVertexVectorData& args){
-    std::string v_idx = get_nth_word(args.vertex_data, '/', 0);
-    std::string UV_idx = get_nth_word(args.vertex_data, '/', 1);
-    std::string n_idx = get_nth_word(args.vertex_data, '/', 2);
-
-    if (v_idx != ""){
-        args.v = args.vertex_array[std::stoi(v_idx)-1];
-        args.v_success = true;
-    }
-
-    if (UV_idx != ""){
-        args.uv = args.vertex_UV_array[std::stoi(UV_idx)-1];
-        args.uv_success = true;
-    }
-
-    if (n_idx != ""){
-        args.n = args.vertex_normal_array[std::stoi(n_idx)-1];
-        args.n_success = true;
-    }
-}
-
-
-TriangleCreationResult construct_triangle(TriangleConstructionArgs& args){
-    std::string v1_data = get_nth_word(args.triangle_data, ' ', args.idx1);
-    PopulateVertexVectorData data1 = PopulateVertexVectorData(v1_data, args.vertex_array, args.vertex_UV_array, args.vertex_normal_array);
-    populate_vertex_vectors(data1);
-
-    std::string v2_data = get_nth_word(args.triangle_data, ' ', args.idx2);
-    PopulateVertexVectorData data2 = PopulateVertexVectorData(v2_data, args.vertex_array, args.vertex_UV_array, args.vertex_normal_array);
-    populate_vertex_vectors(data2);
-
-    std::string v3_data = get_nth_word(args.triangle_data, ' ', args.idx3);
-    PopulateVertexVectorData data3 = PopulateVertexVectorData(v3_data, args.vertex_array, args.vertex_UV_array, args.vertex_normal_array);
-    populate_vertex_vectors(data3);
-
-    bool loaded_vertices_successfully = data1.v_success && data2.v_success && data3.v_success;
-
-    TriangleCreationResult result;
-
-    if (!loaded_vertices_successfully){
-        return result;
-    }
-
-    Triangle* triangle = new Triangle(data1.v, data2.v, data3.v, args.material);
-
-    bool loaded_UV_successfully = data1.uv_success && data2.uv_success && data3.uv_success;
-    if (loaded_UV_successfully){triangle -> set_vertex_UV(data1.uv, data2.uv, data3.uv);}
-
-    bool loaded_normals_successfully  = data1.n_success && data2.n_success && data3.n_success;
-    if (loaded_normals_successfully && args.enable_smooth_shading){
-        triangle -> set_vertex_normals(data1.n, data2.n, data3.n);
-    }
-    result.success = true;
-    result.triangle = triangle;
-    return result;
-}
-
-
-int populate_triangle_array(std::string file_name, vec3* vertex_array, vec3* vertex_UV_array, vec3* vertex_normal_array, Object** triangle_array, Material* material, const bool enable_smooth_shading){
-    std::ifstream model_file(file_name);
-    std::string line;
-    int shape_idx = 0;
-    while(std::getline(model_file, line)){
-        std::string first_word = get_nth_word(line, ' ', 0);
-
-        bool is_shape = first_word == "f";
-        if (!is_shape){
-            continue;
-        }
-        int number_of_spaces = number_of_char_occurances(line, ' ');
-        bool is_triangle = number_of_spaces == 3;
-        bool is_quad = number_of_spaces == 4;
-        if (is_triangle){
-            TriangleConstructionArgs args = TriangleConstructionArgs(line, 1, 2, 3, material, vertex_array, vertex_UV_array, vertex_normal_array, enable_smooth_shading);
-            TriangleCreationResult result = construct_triangle(args);
-            if (!result.success){
-                continue;
-            }
-            triangle_array[shape_idx] = result.triangle;
-            shape_idx++;
-        }
-
-        else if (is_quad){
-            TriangleConstructionArgs args1 = TriangleConstructionArgs(line, 1, 2, 3, material, vertex_array, vertex_UV_array, vertex_normal_array, enable_smooth_shading);
-            TriangleCreationResult result1 = construct_triangle(args1);
-            if (result1.success){
-                triangle_array[shape_idx] = result1.triangle;
-                shape_idx++;
-            }
-
-            TriangleConstructionArgs args2 = TriangleConstructionArgs(line, 1, 3, 4, material, vertex_array, vertex_UV_array, vertex_normal_array, enable_smooth_shading);
-            TriangleCreationResult result2 = construct_triangle(args2);
-            if (result1.success){
-                triangle_array[shape_idx] = result2.triangle;
-                shape_idx++;
-            }
-        }
-    }
-    return shape_idx;
-}
-
-
-ObjectUnion* load_object_model(std::string file_name, Material* material, const bool enable_smooth_shading, const bool move_object, const vec3& center, const double size){
-    DataSizes nums = get_vertex_data_sizes(file_name);
-
-    vec3 vertex_array[nums.num_vertices];
-    vec3 vertex_UV_array[nums.num_vertex_UVs];
-    vec3 vertex_normal_array[nums.num_vertex_normals];
-    populate_vertex_arrays(file_name, vertex_array, vertex_UV_array, vertex_normal_array);
-
-    if (move_object){
-        change_vectors(center, size, vertex_array, nums.num_vertices);
-    }
-
-    Object** triangles = new Object*[nums.num_triangles];
-    int num_valid_triangles = populate_triangle_array(file_name, vertex_array, vertex_UV_array, vertex_normal_array, triangles, material, enable_smooth_shading);
-    ObjectUnion* loaded_object = new ObjectUnion(triangles, num_valid_triangles, true);
-    return loaded_object;
-}
@@ -0,0 +1,462 @@
+#include "objloader.h"
+#include "trianglemesh.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+MappedFile::MappedFile(const std::string& file_name){
+    // Leaves the file closed, with a null begin(), if it cannot be read. An empty file is open, but also has no data.
+    data = nullptr;
+    file_size = 0;
+    fd = open(file_name.c_str(), O_RDONLY);
+    if (fd == -1){
+        return;
+    }
+
+    struct stat file_status;
+    if (fstat(fd, &file_status) == -1){
+        close(fd);
+        fd = -1;
+        return;
+    }
+    file_size = file_status.st_size;
+    if (file_size == 0){
+        return;
+    }
+
+    void* mapping = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED){
+        close(fd);
+        fd = -1;
+        file_size = 0;
+        return;
+    }
+    madvise(mapping, file_size, MADV_SEQUENTIAL);
+    data = static_cast<const char*>(mapping);
+}
+
+MappedFile::~MappedFile(){
+    if (data){
+        munmap(const_cast<char*>(data), file_size);
+    }
+    if (fd != -1){
+        close(fd);
+    }
+}
+
+const char* MappedFile::begin() const { return data; }
+const char* MappedFile::end() const { return data + file_size; }
+size_t MappedFile::size() const { return file_size; }
+bool MappedFile::is_open() const { return fd != -1; }
+
+
+inline bool is_space(const char c){
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool is_digit(const char c){
+    return c >= '0' && c <= '9';
+}
+
+inline const char* skip_spaces(const char* p, const char* end){
+    while (p < end && is_space(*p)){
+        p++;
+    }
+    return p;
+}
+
+inline const char* skip_token(const char* p, const char* end){
+    while (p < end && !is_space(*p)){
+        p++;
+    }
+    return p;
+}
+
+
+bool parse_float(const char*& p, const char* end, double& value){
+    // Reads up to 19 significant digits into an integer. With at most 15 of them, and a decimal exponent within 22,
+    // both the integer and the power of ten are exact doubles, so one multiplication or division rounds correctly and
+    // gives the same value as strtod. Everything else, such as long mantissas, large exponents, inf and nan, is handed
+    // to strtod on a copy of the token. Advances p past the number.
+    static const double powers_of_ten[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char* start = p;
+    const char* q = p;
+    bool negative = false;
+    if (q < end && (*q == '-' || *q == '+')){
+        negative = *q == '-';
+        q++;
+    }
+
+    unsigned long long mantissa = 0;
+    int significant_digits = 0;
+    int exponent = 0;
+    bool has_digits = false;
+    bool truncated = false;
+    while (q < end && is_digit(*q)){
+        has_digits = true;
+        if (significant_digits < 19){
+            mantissa = 10 * mantissa + (*q - '0');
+            significant_digits += mantissa > 0;
+        }
+        else{
+            exponent++;
+            truncated = true;
+        }
+        q++;
+    }
+    if (q < end && *q == '.'){
+        q++;
+        while (q < end && is_digit(*q)){
+            has_digits = true;
+            if (significant_digits < 19){
+                mantissa = 10 * mantissa + (*q - '0');
+                significant_digits += mantissa > 0;
+                exponent--;
+            }
+            else{
+                truncated = true;
+            }
+            q++;
+        }
+    }
+
+    bool fast_path = has_digits && !truncated && significant_digits <= 15;
+    if (fast_path && q < end && (*q == 'e' || *q == 'E')){
+        const char* exponent_start = q + 1;
+        int written_exponent;
+        if (parse_int(exponent_start, end, written_exponent) && std::abs(written_exponent) < 1000){
+            exponent += written_exponent;
+            q = exponent_start;
+        }
+        else{
+            fast_path = false;
+        }
+    }
+    if (fast_path && (q == end || is_space(*q)) && exponent >= -22 && exponent <= 22){
+        double result = double(mantissa);
+        result = exponent < 0 ? result / powers_of_ten[-exponent] : result * powers_of_ten[exponent];
+        value = negative ? -result : result;
+        p = q;
+        return true;
+    }
+
+    const char* token_end = skip_token(start, end);
+    std::string token(start, token_end);
+    char* parsed_end;
+    value = strtod(token.c_str(), &parsed_end);
+    if (parsed_end == token.c_str()){
+        return false;
+    }
+    p = start + (parsed_end - token.c_str());
+    return true;
+}
+
+
+bool parse_int(const char*& p, const char* end, int& value){
+    const char* q = p;
+    bool negative = false;
+    if (q < end && (*q == '-' || *q == '+')){
+        negative = *q == '-';
+        q++;
+    }
+    if (q == end || !is_digit(*q)){
+        return false;
+    }
+    long long result = 0;
+    while (q < end && is_digit(*q)){
+        result = std::min(10 * result + (*q - '0'), 2147483647LL);
+        q++;
+    }
+    value = negative ? -result : result;
+    p = q;
+    return true;
+}
+
+
+bool parse_floats(const char*& p, const char* end, double* values, const int count){
+    for (int i = 0; i < count; i++){
+        p = skip_spaces(p, end);
+        if (!parse_float(p, end, values[i])){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int resolve_index(const int index, const int number_of_elements){
+    // OBJ indices start at 1, and negative ones count back from the last element read so far. 0 is invalid.
+    if (index > 0){
+        return index - 1;
+    }
+    if (index < 0 && number_of_elements + index >= 0){
+        return number_of_elements + index;
+    }
+    return -1;
+}
+
+
+obj_statement read_statement(const char*& p, const char* end){
+    // Finds which statement the line starting at p is, and moves p past its keyword.
+    p = skip_spaces(p, end);
+    if (end - p >= 2 && p[0] == 'v' && is_space(p[1])){
+        p += 2;
+        return VERTEX_STATEMENT;
+    }
+    if (end - p >= 3 && p[0] == 'v' && p[1] == 't' && is_space(p[2])){
+        p += 3;
+        return UV_STATEMENT;
+    }
+    if (end - p >= 3 && p[0] == 'v' && p[1] == 'n' && is_space(p[2])){
+        p += 3;
+        return NORMAL_STATEMENT;
+    }
+    if (end - p >= 2 && p[0] == 'f' && is_space(p[1])){
+        p += 2;
+        return FACE_STATEMENT;
+    }
+    return OTHER_STATEMENT;
+}
+
+
+inline const char* find_line_end(const char* p, const char* end){
+    const char* line_end = static_cast<const char*>(memchr(p, '\n', end - p));
+    return line_end ? line_end : end;
+}
+
+
+bool parse_face_corner(const char*& p, const char* end, const ElementCounts& read, const ElementCounts& totals, VertexIndices& corner){
+    // One of v, v/vt, v//vn or v/vt/vn. read counts the elements read so far, which relative indices refer to, and
+    // indices past the totals in the whole file make the corner invalid. UVs and normals referred to before any has
+    // been read are ignored.
+    int index;
+    if (!parse_int(p, end, index)){
+        return false;
+    }
+    corner.position = resolve_index(index, read.positions);
+    if (corner.position >= totals.positions){
+        return false;
+    }
+    if (p == end || *p != '/'){
+        return true;
+    }
+    p++;
+    if (p < end && *p != '/'){
+        if (!parse_int(p, end, index)){
+            return false;
+        }
+        corner.UV = read.UVs > 0 ? resolve_index(index, read.UVs) : -1;
+        if (corner.UV >= totals.UVs){
+            return false;
+        }
+    }
+    if (p == end || *p != '/'){
+        return true;
+    }
+    p++;
+    if (!parse_int(p, end, index)){
+        return false;
+    }
+    corner.normal = read.normals > 0 ? resolve_index(index, read.normals) : -1;
+    return corner.normal < totals.normals;
+}
+
+
+void add_triangle(ObjectChunk& chunk, const VertexIndices& a, const VertexIndices& b, const VertexIndices& c, const bool store_UVs, const bool store_normals){
+    // Triangles with a missing position are dropped. UVs and normals apply to a triangle only if all its vertices have
+    // them, and are otherwise -1.
+    if (a.position < 0 || b.position < 0 || c.position < 0){
+        return;
+    }
+    const VertexIndices* corners[3] = {&a, &b, &c};
+    bool has_UVs = a.UV >= 0 && b.UV >= 0 && c.UV >= 0;
+    bool has_normals = a.normal >= 0 && b.normal >= 0 && c.normal >= 0;
+    for (int i = 0; i < 3; i++){
+        chunk.position_indices.push_back(corners[i] -> position);
+        if (store_UVs){
+            chunk.UV_indices.push_back(has_UVs ? corners[i] -> UV : -1);
+        }
+        if (store_normals){
+            chunk.normal_indices.push_back(has_normals ? corners[i] -> normal : -1);
+        }
+    }
+}
+
+
+void parse_vertex_lines(ObjectChunk& chunk){
+    // First pass: reads the positions, UVs and normals of the chunk and counts its lines. Stops at the first line that
+    // cannot be read.
+    const char* p = chunk.begin;
+    chunk.number_of_lines = 0;
+    while (p < chunk.end){
+        const char* line_end = find_line_end(p, chunk.end);
+        const char* q = p;
+        bool valid = true;
+        double values[3];
+        switch (read_statement(q, line_end)){
+            case VERTEX_STATEMENT:
+                valid = parse_floats(q, line_end, values, 3);
+                chunk.positions.push_back(vec3(values[0], values[1], values[2]));
+                break;
+            case UV_STATEMENT:
+                valid = parse_floats(q, line_end, values, 2);
+                chunk.UVs.push_back(vec3(values[0], values[1], 0));
+                break;
+            case NORMAL_STATEMENT:
+                valid = parse_floats(q, line_end, values, 3);
+                chunk.normals.push_back(vec3(values[0], values[1], values[2]));
+                break;
+            default:
+                break;
+        }
+        if (!valid){
+            chunk.error_line = chunk.number_of_lines;
+            return;
+        }
+        chunk.number_of_lines++;
+        p = line_end + 1;
+    }
+}
+
+
+void parse_face_lines(ObjectChunk& chunk, const ElementCounts& totals, const bool store_UVs, const bool store_normals){
+    // Second pass: splits the faces of the chunk into triangles. The vertex lines are only counted, starting from the
+    // number of elements in the chunks before, so that indices resolve as if the file had been read from the start.
+    ElementCounts read;
+    read.positions = chunk.position_offset;
+    read.UVs = chunk.UV_offset;
+    read.normals = chunk.normal_offset;
+    std::vector<VertexIndices> corners;
+    const char* p = chunk.begin;
+    int line = 0;
+    while (p < chunk.end && line != chunk.error_line){
+        const char* line_end = find_line_end(p, chunk.end);
+        const char* q = p;
+        switch (read_statement(q, line_end)){
+            case VERTEX_STATEMENT:
+                read.positions++;
+                break;
+            case UV_STATEMENT:
+                read.UVs++;
+                break;
+            case NORMAL_STATEMENT:
+                read.normals++;
+                break;
+            case FACE_STATEMENT:{
+                corners.clear();
+                q = skip_spaces(q, line_end);
+                while (q < line_end){
+                    VertexIndices corner;
+                    if (!parse_face_corner(q, line_end, read, totals, corner)){
+                        chunk.error_line = line;
+                        return;
+                    }
+                    corners.push_back(corner);
+                    q = skip_spaces(skip_token(q, line_end), line_end);
+                }
+                for (size_t i = 1; i + 1 < corners.size(); i++){
+                    add_triangle(chunk, corners[0], corners[i], corners[i+1], store_UVs, store_normals);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        line++;
+        p = line_end + 1;
+    }
+}
+
+
+std::vector<ObjectChunk> split_into_chunks(const char* begin, const char* end, const size_t chunk_size){
+    // Chunks of about chunk_size bytes that end after a line break, so every line falls into exactly one of them.
+    std::vector<ObjectChunk> chunks;
+    const char* p = begin;
+    while (p < end){
+        const char* chunk_end = end;
+        if (size_t(end - p) > chunk_size){
+            chunk_end = find_line_end(p + chunk_size, end);
+            chunk_end = std::min(chunk_end + 1, end);
+        }
+        ObjectChunk chunk;
+        chunk.begin = p;
+        chunk.end = chunk_end;
+        chunks.push_back(chunk);
+        p = chunk_end;
+    }
+    return chunks;
+}
+
+
+void parse_object_file(const std::string& file_name, MeshData& data, const bool enable_smooth_shading){
+    // Parses the mapped file in chunks of whole lines on the thread pool, without copying lines or allocating per
+    // token. Polygons are split into a fan of triangles around their first vertex, and unknown statements are skipped.
+    // Prefix sums over the chunks give where their elements go, so the result is the same as reading the file in
+    // order, whatever the number of threads.
+    MappedFile file(file_name);
+    if (!file.is_open()){
+        throw std::invalid_argument("Could not open model file " + file_name + ".");
+    }
+    std::vector<ObjectChunk> chunks = split_into_chunks(file.begin(), file.end(), constants::obj_parallel_chunk_size);
+    int number_of_chunks = chunks.size();
+    ThreadPool& thread_pool = get_thread_pool();
+
+    thread_pool.parallel_for(number_of_chunks, 1, [&chunks](const int chunk, const int, const int){
+        parse_vertex_lines(chunks[chunk]);
+    });
+    ElementCounts totals;
+    int number_of_lines = 0;
+    for (int i = 0; i < number_of_chunks; i++){
+        chunks[i].position_offset = totals.positions;
+        chunks[i].UV_offset = totals.UVs;
+        chunks[i].normal_offset = totals.normals;
+        chunks[i].first_line = number_of_lines;
+        totals.positions += chunks[i].positions.size();
+        totals.UVs += chunks[i].UVs.size();
+        totals.normals += chunks[i].normals.size();
+        number_of_lines += chunks[i].number_of_lines;
+    }
+
+    // UVs and normals are only stored if the file has any.
+    bool store_UVs = totals.UVs > 0;
+    bool store_normals = totals.normals > 0 && enable_smooth_shading;
+    thread_pool.parallel_for(number_of_chunks, 1, [&chunks, &totals, store_UVs, store_normals](const int chunk, const int, const int){
+        parse_face_lines(chunks[chunk], totals, store_UVs, store_normals);
+    });
+    int number_of_indices = 0;
+    for (int i = 0; i < number_of_chunks; i++){
+        if (chunks[i].error_line != -1){
+            int line_number = chunks[i].first_line + chunks[i].error_line + 1;
+            throw std::invalid_argument("Could not parse line " + std::to_string(line_number) + " of " + file_name + ".");
+        }
+        chunks[i].index_offset = number_of_indices;
+        number_of_indices += chunks[i].position_indices.size();
+    }
+
+    data.positions.resize(totals.positions);
+    data.UVs.resize(totals.UVs);
+    data.normals.resize(totals.normals);
+    data.position_indices.resize(number_of_indices);
+    data.UV_indices.resize(store_UVs ? number_of_indices : 0);
+    data.normal_indices.resize(store_normals ? number_of_indices : 0);
+    thread_pool.parallel_for(number_of_chunks, 1, [&chunks, &data](const int chunk, const int, const int){
+        ObjectChunk& c = chunks[chunk];
+        std::copy(c.positions.begin(), c.positions.end(), data.positions.begin() + c.position_offset);
+        std::copy(c.UVs.begin(), c.UVs.end(), data.UVs.begin() + c.UV_offset);
+        std::copy(c.normals.begin(), c.normals.end(), data.normals.begin() + c.normal_offset);
+        std::copy(c.position_indices.begin(), c.position_indices.end(), data.position_indices.begin() + c.index_offset);
+        std::copy(c.UV_indices.begin(), c.UV_indices.end(), data.UV_indices.begin() + c.index_offset);
+        std::copy(c.normal_indices.begin(), c.normal_indices.end(), data.normal_indices.begin() + c.index_offset);
+        c = ObjectChunk();
+    });
+}
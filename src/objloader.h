@@ -0,0 +1,87 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "vec3.h"
+
+
+struct MeshData;
+
+
+class MappedFile{
+    // A whole file mapped read-only into memory, unmapped again when this goes out of scope.
+    public:
+        MappedFile(const std::string& file_name);
+        ~MappedFile();
+
+        const char* begin() const;
+        const char* end() const;
+        size_t size() const;
+        bool is_open() const;
+
+    private:
+        const char* data;
+        size_t file_size;
+        int fd;
+
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+};
+
+
+struct VertexIndices{
+    int position = -1;
+    int UV = -1;
+    int normal = -1;
+};
+
+
+enum obj_statement{
+    OTHER_STATEMENT = 0,
+    VERTEX_STATEMENT = 1,
+    UV_STATEMENT = 2,
+    NORMAL_STATEMENT = 3,
+    FACE_STATEMENT = 4
+};
+
+
+struct ElementCounts{
+    int positions = 0;
+    int UVs = 0;
+    int normals = 0;
+};
+
+
+struct ObjectChunk{
+    // A range of whole lines of an OBJ file, which is parsed on its own. The offsets say where its lines, vertex data
+    // and triangle indices start in the whole file, and come from prefix sums over the chunks before it.
+    const char* begin;
+    const char* end;
+    int number_of_lines = 0;
+    int error_line = -1; // First line within the chunk that could not be parsed, or -1.
+    std::vector<vec3> positions;
+    std::vector<vec3> UVs;
+    std::vector<vec3> normals;
+    std::vector<int> position_indices;
+    std::vector<int> UV_indices;
+    std::vector<int> normal_indices;
+    int first_line = 0;
+    int position_offset = 0;
+    int UV_offset = 0;
+    int normal_offset = 0;
+    int index_offset = 0;
+};
+
+
+bool parse_float(const char*& p, const char* end, double& value);
+bool parse_int(const char*& p, const char* end, int& value);
+bool parse_floats(const char*& p, const char* end, double* values, const int count);
+obj_statement read_statement(const char*& p, const char* end);
+void parse_vertex_lines(ObjectChunk& chunk);
+void parse_face_lines(ObjectChunk& chunk, const ElementCounts& totals, const bool store_UVs, const bool store_normals);
+std::vector<ObjectChunk> split_into_chunks(const char* begin, const char* end, const size_t chunk_size);
+void parse_object_file(const std::string& file_name, MeshData& data, const bool enable_smooth_shading);
+
+#endif
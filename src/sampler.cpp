@@ -0,0 +1,44 @@
+#include "sampler.h"
+#include <cmath>
+
+
+inline uint64_t mix_bits(uint64_t x){
+    // Finalizer of splitmix64, every input bit affects every output bit.
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+
+Sampler::Sampler(const uint64_t _pixel_index, const uint64_t _sample_index, const uint64_t _seed){
+    pixel_index = _pixel_index;
+    sample_index = _sample_index;
+    stream_key = mix_bits(mix_bits(_seed ^ mix_bits(pixel_index)) + sample_index * 0x9e3779b97f4a7c15ULL);
+    dimension = 0;
+}
+
+uint64_t Sampler::get_pixel_index() const { return pixel_index; }
+uint64_t Sampler::get_sample_index() const { return sample_index; }
+
+uint64_t Sampler::next(){
+    dimension++;
+    return mix_bits(stream_key + dimension * 0x9e3779b97f4a7c15ULL);
+}
+
+double Sampler::random_uniform(const double low, const double high){
+    // The upper 53 bits give a double in [0, 1).
+    double uniform = (next() >> 11) * (1.0 / 9007199254740992.0);
+    return (high - low) * uniform + low;
+}
+
+int Sampler::random_int(const int low, const int high){
+    // Returns a random int between low (inclusive) and high (exclusive).
+    return (int) random_uniform(low, high);
+}
+
+double Sampler::random_normal(){
+    // Box-Muller transform, 1 - u keeps the logarithm finite.
+    double u1 = 1.0 - random_uniform(0, 1);
+    double u2 = random_uniform(0, 1);
+    return sqrt(-2.0 * std::log(u1)) * cos(2.0 * M_PI * u2);
+}
@@ -0,0 +1,29 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include "constants.h"
+
+
+class Sampler{
+    // Counter-based random numbers: every value is a hash of (seed, pixel, sample, dimension), so a sample
+    // produces the same random sequence regardless of which thread renders it or in which order.
+    public:
+        Sampler(const uint64_t _pixel_index=0, const uint64_t _sample_index=0, const uint64_t _seed=constants::random_seed);
+
+        uint64_t get_pixel_index() const;
+        uint64_t get_sample_index() const;
+        double random_uniform(const double low, const double high);
+        int random_int(const int low, const int high);
+        double random_normal();
+
+    private:
+        uint64_t pixel_index;
+        uint64_t sample_index;
+        uint64_t stream_key;
+        uint64_t dimension;
+
+        uint64_t next();
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+#include "objects.h"
+#include "camera.h"
+#include "materials.h"
+#include "medium.h"
+#include "trianglemesh.h"
+#include "scenegeometry.h"
+#include "environmentmap.h"
+
+
+struct Scene{
+    Object** objects;
+    int number_of_objects;
+    SceneGeometry* geometry;
+    Camera* camera;
+    MaterialManager* material_manager;
+    Medium* medium;
+    // Light from rays that leave the scene, such as a sky. The default scene only has one with enable_environment_map,
+    // which leaves out the closed room.
+    EnvironmentMap* environment = nullptr;
+    // Meshes shared by instances. The instances in objects refer to them, the scene owns them.
+    std::vector<TriangleMesh*> meshes;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "scenecache.h"
+#include "objloader.h"
+
+
+CacheWriter::CacheWriter(const std::string& _file_name, const cache_kind kind, const uint64_t source_hash, const uint64_t settings_hash){
+    file_name = _file_name;
+    temporary_file_name = file_name + ".tmp";
+    cache_file = fopen(temporary_file_name.c_str(), "wb");
+    success = cache_file != nullptr;
+    if (!success){
+        perror("Error opening scene cache file.");
+        return;
+    }
+
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, scene_cache_magic, sizeof(header.magic));
+    header.version = scene_cache_version;
+    header.kind = kind;
+    header.source_hash = source_hash;
+    header.settings_hash = settings_hash;
+    write(header);
+}
+
+CacheWriter::~CacheWriter(){
+    // Only reached with an open file if close() was never called, in which case the cache is incomplete.
+    if (cache_file){
+        fclose(cache_file);
+        std::remove(temporary_file_name.c_str());
+    }
+}
+
+void CacheWriter::write_bytes(const void* bytes, const size_t size){
+    if (success && size > 0){
+        success = fwrite(bytes, size, 1, cache_file) == 1;
+    }
+}
+
+bool CacheWriter::close(){
+    if (!cache_file){
+        return false;
+    }
+    success = fclose(cache_file) == 0 && success;
+    cache_file = nullptr;
+    if (!success || std::rename(temporary_file_name.c_str(), file_name.c_str()) != 0){
+        perror("Error writing scene cache file.");
+        std::remove(temporary_file_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+CacheReader::CacheReader(const char* _begin, const char* _end){
+    p = _begin;
+    end = _end;
+    valid = p != nullptr;
+}
+
+bool CacheReader::read_bytes(void* bytes, const size_t size){
+    if (!valid || size > size_t(end - p)){
+        valid = false;
+        return false;
+    }
+    if (size > 0){
+        std::memcpy(bytes, p, size);
+        p += size;
+    }
+    return true;
+}
+
+bool CacheReader::read_header(const cache_kind kind, const uint64_t source_hash, const uint64_t settings_hash){
+    CacheHeader header;
+    if (!read_bytes(&header, sizeof(header))){
+        return false;
+    }
+    valid = std::memcmp(header.magic, scene_cache_magic, sizeof(header.magic)) == 0
+         && header.version == scene_cache_version
+         && header.kind == uint32_t(kind)
+         && header.source_hash == source_hash
+         && header.settings_hash == settings_hash;
+    return valid;
+}
+
+void CacheReader::invalidate(){
+    // For inconsistencies in what was read, which only the caller can notice.
+    valid = false;
+}
+
+bool CacheReader::is_valid() const { return valid; }
+bool CacheReader::is_at_end() const { return p == end; }
+
+
+inline uint64_t mix_word(uint64_t hash, const uint64_t word){
+    hash ^= word * 0x9E3779B97F4A7C15ULL;
+    hash = (hash << 31) | (hash >> 33);
+    return hash * 0xC2B2AE3D27D4EB4FULL;
+}
+
+inline uint64_t load_word(const char* p){
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+uint64_t hash_bytes(const char* begin, const char* end, uint64_t seed){
+    // Not a cryptographic hash, it only has to notice that a file changed. Four independent lanes over 8 byte words
+    // keep the multiplications of neighbouring words from waiting on each other, so hashing runs at memory speed.
+    uint64_t lanes[4] = {seed ^ 0x243F6A8885A308D3ULL, seed ^ 0x13198A2E03707344ULL, seed ^ 0xA4093822299F31D0ULL, seed ^ 0x082EFA98EC4E6C89ULL};
+    const char* p = begin;
+    for (; end - p >= 32; p += 32){
+        for (int i = 0; i < 4; i++){
+            lanes[i] = mix_word(lanes[i], load_word(p + 8 * i));
+        }
+    }
+
+    uint64_t hash = mix_word(seed, uint64_t(end - begin));
+    for (int i = 0; i < 4; i++){
+        hash = mix_word(hash, lanes[i]);
+    }
+    for (; end - p >= 8; p += 8){
+        hash = mix_word(hash, load_word(p));
+    }
+    uint64_t tail = 0;
+    if (p < end){
+        std::memcpy(&tail, p, end - p);
+    }
+    hash = mix_word(hash, tail);
+
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool hash_file(const std::string& file_name, uint64_t& hash){
+    MappedFile file(file_name);
+    if (!file.is_open()){
+        return false;
+    }
+    hash = hash_bytes(file.begin(), file.end());
+    return true;
+}
+
+std::string cache_file_name(const std::string& source_file_name){
+    return source_file_name + constants::scene_cache_extension;
+}
@@ -0,0 +1,124 @@
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "constants.h"
+
+
+enum cache_kind{
+    MESH_CACHE = 1,
+    VALUE_MAP_CACHE = 2
+};
+
+
+struct CacheHeader{
+    // source_hash is taken over the whole source file, and settings_hash over everything else the cached data depends
+    // on, including the sizes and layouts of the stored types.
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    uint64_t source_hash;
+    uint64_t settings_hash;
+};
+
+
+const char scene_cache_magic[8] = {'R', 'T', 'S', 'C', 'A', 'C', 'H', 'E'};
+const uint32_t scene_cache_version = 2;
+
+
+class CacheWriter{
+    // Writes a cache to a temporary file, which close() renames to its final name once everything is written, so a
+    // process killed mid-write never leaves a truncated cache behind. Vectors are stored as their length followed by
+    // their raw bytes, so only trivially copyable types can be written.
+    public:
+        CacheWriter(const std::string& _file_name, const cache_kind kind, const uint64_t source_hash, const uint64_t settings_hash);
+        ~CacheWriter();
+
+        template <class T>
+        void write(const T& value);
+        template <class T>
+        void write_vector(const std::vector<T>& values);
+        bool close();
+
+    private:
+        std::string file_name;
+        std::string temporary_file_name;
+        FILE* cache_file;
+        bool success;
+
+        void write_bytes(const void* bytes, const size_t size);
+
+        CacheWriter(const CacheWriter&);
+        CacheWriter& operator=(const CacheWriter&);
+};
+
+
+class CacheReader{
+    // Reads back what a CacheWriter wrote, from a cache file mapped into memory. Reading past the end or a vector
+    // longer than what is left makes the reader invalid, and every read after that leaves its target untouched.
+    public:
+        CacheReader(const char* _begin, const char* _end);
+
+        bool read_header(const cache_kind kind, const uint64_t source_hash, const uint64_t settings_hash);
+        template <class T>
+        void read(T& value);
+        template <class T>
+        void read_vector(std::vector<T>& values);
+        void invalidate();
+        bool is_valid() const;
+        bool is_at_end() const;
+
+    private:
+        const char* p;
+        const char* end;
+        bool valid;
+
+        bool read_bytes(void* bytes, const size_t size);
+};
+
+
+template <class T>
+void CacheWriter::write(const T& value){
+    write_bytes(&value, sizeof(T));
+}
+
+template <class T>
+void CacheWriter::write_vector(const std::vector<T>& values){
+    write(uint64_t(values.size()));
+    write_bytes(values.data(), values.size() * sizeof(T));
+}
+
+template <class T>
+void CacheReader::read(T& value){
+    read_bytes(&value, sizeof(T));
+}
+
+template <class T>
+void CacheReader::read_vector(std::vector<T>& values){
+    uint64_t size = 0;
+    read(size);
+    if (!valid || size > uint64_t(end - p) / sizeof(T)){
+        valid = false;
+        return;
+    }
+    values.resize(size);
+    read_bytes(values.data(), size * sizeof(T));
+}
+
+
+uint64_t hash_bytes(const char* begin, const char* end, uint64_t seed=0);
+bool hash_file(const std::string& file_name, uint64_t& hash);
+std::string cache_file_name(const std::string& source_file_name);
+
+template <class T>
+uint64_t hash_value(const uint64_t seed, const T& value){
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    return hash_bytes(bytes, bytes + sizeof(T), seed);
+}
+
+#endif
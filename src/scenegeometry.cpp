@@ -0,0 +1,251 @@
+#include "scenegeometry.h"
+
+
+SceneGeometry::SceneGeometry(Object** _objects, const int _number_of_objects, const EnvironmentMap* _environment){
+    objects = _objects;
+    number_of_objects = _number_of_objects;
+    environment = _environment;
+
+    std::vector<BVH::BuildPrimitive> build_primitives;
+    for (int i = 0; i < number_of_objects; i++){
+        primitives.push_back(compile_primitive(i));
+        if (!objects[i] -> is_bounded()){
+            unbounded_primitives.push_back(primitives[i]);
+            continue;
+        }
+        BVH::BuildPrimitive primitive;
+        primitive.bounds.min_point = objects[i] -> min_axis_point();
+        primitive.bounds.max_point = objects[i] -> max_axis_point();
+        primitive.centroid = objects[i] -> compute_centroid();
+        primitive.index = i;
+        build_primitives.push_back(primitive);
+    }
+
+    bvh = BVH::BoundingVolumeHierarchy<geometry_scalar>(build_primitives);
+    for (size_t i = 0; i < build_primitives.size(); i++){
+        bounded_primitives.push_back(primitives[build_primitives[i].index]);
+    }
+
+    std::vector<double> light_powers;
+    for (int i = 0; i < number_of_objects; i++){
+        if (objects[i] -> is_light_source()){
+            light_sources.push_back(i);
+            light_powers.push_back(objects[i] -> light_power());
+        }
+    }
+    if (environment){
+        // The power of the environment is what falls onto a sphere around the bounded objects.
+        BVH::AxisAlignedBox scene_bounds = BVH::empty_box();
+        for (size_t i = 0; i < build_primitives.size(); i++){
+            BVH::grow_box(scene_bounds, build_primitives[i].bounds);
+        }
+        double scene_radius = build_primitives.empty() ? 1 : (scene_bounds.max_point - scene_bounds.min_point).length() / 2.0;
+        light_sources.push_back(environment_light_index);
+        light_powers.push_back(environment -> power(scene_radius));
+    }
+
+    light_distribution = AliasTable(light_powers);
+    light_selection_pdfs.assign(number_of_objects, 0);
+    environment_selection_pdf = 0;
+    for (size_t i = 0; i < light_sources.size(); i++){
+        if (light_sources[i] == environment_light_index){
+            environment_selection_pdf = light_distribution.pdf(i);
+            continue;
+        }
+        light_selection_pdfs[light_sources[i]] = light_distribution.pdf(i);
+    }
+}
+
+
+int SceneGeometry::sample_light_source(Sampler& sampler, double& selection_pdf) const{
+    // Returns the object index of a light source drawn by power, environment_light_index for the environment, or -1 if
+    // there is nothing to draw.
+    if (light_sources.empty()){
+        return -1;
+    }
+    return light_sources[light_distribution.sample(sampler, selection_pdf)];
+}
+
+
+double SceneGeometry::light_selection_pdf(const int object_index) const{
+    if (object_index == environment_light_index){
+        return environment_selection_pdf;
+    }
+    return light_selection_pdfs[object_index];
+}
+
+
+PrimitiveReference SceneGeometry::compile_primitive(const int object_index){
+    // Copies what the intersection test of a simple shape needs into the array of its type.
+    PrimitiveReference primitive;
+    primitive.type = objects[object_index] -> get_primitive_type();
+    primitive.index = -1;
+    primitive.object_index = object_index;
+    primitive.primitive_ID = objects[object_index] -> primitive_ID;
+
+    switch (primitive.type){
+        case SPHERE_PRIMITIVE:{
+            const Sphere* sphere = static_cast<const Sphere*>(objects[object_index]);
+            primitive.index = spheres.size();
+            spheres.push_back(SphereRecord{sphere -> position, sphere -> radius});
+            break;
+        }
+        case PLANE_PRIMITIVE:{
+            const Plane* plane = static_cast<const Plane*>(objects[object_index]);
+            primitive.index = planes.size();
+            planes.push_back(PlaneRecord{plane -> position, plane -> normal_vector});
+            break;
+        }
+        case RECTANGLE_PRIMITIVE:{
+            const Rectangle* rectangle = static_cast<const Rectangle*>(objects[object_index]);
+            primitive.index = rectangles.size();
+            rectangles.push_back(RectangleRecord{rectangle -> position, rectangle -> v1, rectangle -> v2, rectangle -> normal_vector, rectangle -> L1, rectangle -> L2});
+            break;
+        }
+        case TRIANGLE_PRIMITIVE:{
+            const Triangle* triangle = static_cast<const Triangle*>(objects[object_index]);
+            primitive.index = triangles.size();
+            triangles.push_back(TriangleRecord{triangle -> p1, triangle -> p2, triangle -> p3});
+            break;
+        }
+        default:
+            break;
+    }
+    return primitive;
+}
+
+
+bool SceneGeometry::intersect_primitive(const PrimitiveReference& primitive, Hit& hit, Ray& ray, const bool any_hit) const{
+    bool success;
+    switch (primitive.type){
+        case SPHERE_PRIMITIVE:{
+            const SphereRecord& sphere = spheres[primitive.index];
+            success = intersect_sphere(sphere.position, sphere.radius, ray, hit.distance);
+            break;
+        }
+        case PLANE_PRIMITIVE:{
+            const PlaneRecord& plane = planes[primitive.index];
+            success = intersect_plane(ray.starting_position - plane.position, plane.normal_vector, ray, hit.distance);
+            break;
+        }
+        case RECTANGLE_PRIMITIVE:{
+            const RectangleRecord& rectangle = rectangles[primitive.index];
+            success = intersect_rectangle(rectangle.position, rectangle.v1, rectangle.v2, rectangle.normal_vector, rectangle.L1, rectangle.L2, ray, hit.distance);
+            break;
+        }
+        case TRIANGLE_PRIMITIVE:{
+            const TriangleRecord& triangle = triangles[primitive.index];
+            success = intersect_triangle(triangle.p1, triangle.p2, triangle.p3, ray, hit.distance);
+            break;
+        }
+        default:
+            if (any_hit){
+                return objects[primitive.object_index] -> find_any_object_hit(hit, ray);
+            }
+            return objects[primitive.object_index] -> find_closest_object_hit(hit, ray);
+    }
+    hit.primitive_ID = primitive.primitive_ID;
+    return success;
+}
+
+
+vec3 SceneGeometry::get_normal_vector(const PrimitiveReference& primitive, const vec3& surface_point, const int primitive_ID) const{
+    const Object* object = objects[primitive.object_index];
+    switch (primitive.type){
+        case SPHERE_PRIMITIVE:
+            return static_cast<const Sphere*>(object) -> Sphere::get_normal_vector(surface_point, primitive_ID);
+        case PLANE_PRIMITIVE:
+            return planes[primitive.index].normal_vector;
+        case RECTANGLE_PRIMITIVE:
+            return rectangles[primitive.index].normal_vector;
+        case TRIANGLE_PRIMITIVE:
+            return static_cast<const Triangle*>(object) -> Triangle::get_normal_vector(surface_point, primitive_ID);
+        default:
+            return object -> get_normal_vector(surface_point, primitive_ID);
+    }
+}
+
+
+void SceneGeometry::complete_hit(Hit& hit, const Ray& ray) const{
+    // Same as the free complete_hit, but looks up the normal by type tag.
+    hit.intersection_point = ray.starting_position + ray.direction_vector * hit.distance;
+    vec3 normal_vector = get_normal_vector(primitives[hit.intersected_object_index], hit.intersection_point, hit.primitive_ID);
+    hit.outside = dot_vectors(ray.direction_vector, normal_vector) < 0;
+    hit.normal_vector = hit.outside ? normal_vector : -normal_vector;
+    hit.incident_vector = ray.direction_vector;
+}
+
+
+bool SceneGeometry::find_closest_hit(Hit& closest_hit, Ray& ray) const{
+    closest_hit.distance = constants::max_ray_distance;
+    bool found_a_hit = false;
+    ray.prepare();
+
+    for (size_t i = 0; i < unbounded_primitives.size(); i++){
+        const PrimitiveReference& primitive = unbounded_primitives[i];
+        Hit hit;
+        bool success = intersect_primitive(primitive, hit, ray);
+        if (success && hit.distance > constants::EPSILON && hit.distance < closest_hit.distance){
+            hit.intersected_object_index = primitive.object_index;
+            closest_hit = hit;
+            ray.t_max = hit.distance;
+            found_a_hit = true;
+        }
+    }
+
+    bool found_a_bounded_hit = bvh.intersect(ray, [this, &closest_hit](const int i, Ray& ray){
+        const PrimitiveReference& primitive = bounded_primitives[i];
+        Hit hit;
+        bool success = intersect_primitive(primitive, hit, ray);
+        if (success && hit.distance > constants::EPSILON && hit.distance < closest_hit.distance){
+            hit.intersected_object_index = primitive.object_index;
+            closest_hit = hit;
+            ray.t_max = hit.distance;
+            return true;
+        }
+        return false;
+    });
+
+    if (!found_a_hit && !found_a_bounded_hit){
+        return false;
+    }
+
+    complete_hit(closest_hit, ray);
+    return true;
+}
+
+
+bool SceneGeometry::blocks_light(const PrimitiveReference& primitive, Ray& ray, const double t_max, bool& crosses_transparent_surface) const{
+    // Objects with their own BVH shorten ray.t_max on a hit, which must not hide whatever lies behind a transparent one.
+    Hit hit;
+    bool success = intersect_primitive(primitive, hit, ray, true);
+    ray.t_max = t_max;
+    if (!success || hit.distance <= constants::EPSILON || hit.distance >= t_max){
+        return false;
+    }
+    if (objects[primitive.object_index] -> get_material(hit.primitive_ID) -> allow_direct_light()){
+        crosses_transparent_surface = true;
+        return false;
+    }
+    return true;
+}
+
+
+bool SceneGeometry::is_occluded(Ray& ray, bool& crosses_transparent_surface) const{
+    // Any-hit query for shadow rays: is there a hit closer than ray.t_max on an object whose material blocks direct
+    // light? Surfaces that let it through do not count, but are reported, since the caller then has to follow the ray
+    // through them and the media behind them.
+    crosses_transparent_surface = false;
+    ray.prepare();
+    const double t_max = ray.t_max;
+
+    for (size_t i = 0; i < unbounded_primitives.size(); i++){
+        if (blocks_light(unbounded_primitives[i], ray, t_max, crosses_transparent_surface)){
+            return true;
+        }
+    }
+
+    return bvh.occluded(ray, [this, t_max, &crosses_transparent_surface](const int i, Ray& ray){
+        return blocks_light(bounded_primitives[i], ray, t_max, crosses_transparent_surface);
+    });
+}
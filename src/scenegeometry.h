@@ -0,0 +1,89 @@
+#ifndef SCENEGEOMETRY_H
+#define SCENEGEOMETRY_H
+
+#include <vector>
+#include "objects.h"
+#include "bvh.h"
+#include "aliastable.h"
+#include "environmentmap.h"
+
+
+struct PrimitiveReference{
+    primitive_type type;
+    int index; // Into the array of its type. Unused for generic objects.
+    int object_index;
+    int primitive_ID;
+};
+
+
+struct SphereRecord{
+    vec3 position;
+    double radius;
+};
+
+
+struct PlaneRecord{
+    vec3 position;
+    vec3 normal_vector;
+};
+
+
+struct RectangleRecord{
+    vec3 position;
+    vec3 v1;
+    vec3 v2;
+    vec3 normal_vector;
+    double L1;
+    double L2;
+};
+
+
+struct TriangleRecord{
+    vec3 p1;
+    vec3 p2;
+    vec3 p3;
+};
+
+
+class SceneGeometry{
+    // The objects of a scene together with a top-level BVH over the bounded ones, such as spheres, rectangles and
+    // object unions, which keep their own BVH over their triangles. Unbounded objects, like infinite planes, are tested
+    // separately for every ray. Does not own the objects.
+    // The simple shapes are compiled into arrays of plain records, one per shape type, which are intersected by a switch
+    // on the type tag of a PrimitiveReference. Only generic objects, like meshes and instances, go through virtual calls.
+    // The light sources are also gathered once, and are sampled in proportion to their estimated power. An environment
+    // map, if there is one, is sampled along with them and stands for whatever rays escape the scene.
+    public:
+        Object** objects;
+        int number_of_objects;
+        const EnvironmentMap* environment;
+
+        SceneGeometry(Object** _objects, const int _number_of_objects, const EnvironmentMap* _environment=nullptr);
+
+        bool find_closest_hit(Hit& closest_hit, Ray& ray) const;
+        bool is_occluded(Ray& ray, bool& crosses_transparent_surface) const;
+        int sample_light_source(Sampler& sampler, double& selection_pdf) const;
+        double light_selection_pdf(const int object_index) const;
+
+    private:
+        BVH::BoundingVolumeHierarchy<geometry_scalar> bvh;
+        std::vector<PrimitiveReference> primitives; // One for every object.
+        std::vector<PrimitiveReference> bounded_primitives; // One for every primitive slot of the BVH.
+        std::vector<PrimitiveReference> unbounded_primitives;
+        std::vector<SphereRecord> spheres;
+        std::vector<PlaneRecord> planes;
+        std::vector<RectangleRecord> rectangles;
+        std::vector<TriangleRecord> triangles;
+        std::vector<int> light_sources; // Object index of every light source, or environment_light_index.
+        AliasTable light_distribution;
+        std::vector<double> light_selection_pdfs; // One for every object, zero if it is not a light source.
+        double environment_selection_pdf;
+
+        PrimitiveReference compile_primitive(const int object_index);
+        bool intersect_primitive(const PrimitiveReference& primitive, Hit& hit, Ray& ray, const bool any_hit=false) const;
+        bool blocks_light(const PrimitiveReference& primitive, Ray& ray, const double t_max, bool& crosses_transparent_surface) const;
+        vec3 get_normal_vector(const PrimitiveReference& primitive, const vec3& surface_point, const int primitive_ID) const;
+        void complete_hit(Hit& hit, const Ray& ray) const;
+};
+
+#endif
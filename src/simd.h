@@ -0,0 +1,141 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+// Thin wrappers over the widest vector registers available for float and double, so that a kernel can be written once
+// for both precisions. Comparisons return masks, which are only combined with each other and turned into bits by
+// movemask. Without SSE2 a lane is a plain scalar and a mask a bool.
+template <class T>
+struct SimdLanes;
+
+
+#if defined(__AVX__)
+template <>
+struct SimdLanes<double>{
+    typedef __m256d type;
+    typedef __m256d mask;
+    static const int width = 4;
+
+    static inline type load(const double* p){ return _mm256_loadu_pd(p); }
+    static inline void store(double* p, const type a){ _mm256_storeu_pd(p, a); }
+    static inline type set(const double value){ return _mm256_set1_pd(value); }
+    static inline type add(const type a, const type b){ return _mm256_add_pd(a, b); }
+    static inline type sub(const type a, const type b){ return _mm256_sub_pd(a, b); }
+    static inline type mul(const type a, const type b){ return _mm256_mul_pd(a, b); }
+    static inline type div(const type a, const type b){ return _mm256_div_pd(a, b); }
+    static inline mask less(const type a, const type b){ return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static inline mask less_equal(const type a, const type b){ return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+    static inline mask equal(const type a, const type b){ return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+    static inline mask mask_and(const mask a, const mask b){ return _mm256_and_pd(a, b); }
+    static inline mask mask_or(const mask a, const mask b){ return _mm256_or_pd(a, b); }
+    static inline mask mask_and_not(const mask a, const mask b){ return _mm256_andnot_pd(b, a); }
+    static inline int movemask(const mask a){ return _mm256_movemask_pd(a); }
+    static inline type abs(const type a){ return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static inline type multiply_sign(const type a, const type b){ return _mm256_xor_pd(a, _mm256_and_pd(b, _mm256_set1_pd(-0.0))); }
+};
+
+
+template <>
+struct SimdLanes<float>{
+    typedef __m256 type;
+    typedef __m256 mask;
+    static const int width = 8;
+
+    static inline type load(const float* p){ return _mm256_loadu_ps(p); }
+    static inline void store(float* p, const type a){ _mm256_storeu_ps(p, a); }
+    static inline type set(const float value){ return _mm256_set1_ps(value); }
+    static inline type add(const type a, const type b){ return _mm256_add_ps(a, b); }
+    static inline type sub(const type a, const type b){ return _mm256_sub_ps(a, b); }
+    static inline type mul(const type a, const type b){ return _mm256_mul_ps(a, b); }
+    static inline type div(const type a, const type b){ return _mm256_div_ps(a, b); }
+    static inline mask less(const type a, const type b){ return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static inline mask less_equal(const type a, const type b){ return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static inline mask equal(const type a, const type b){ return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    static inline mask mask_and(const mask a, const mask b){ return _mm256_and_ps(a, b); }
+    static inline mask mask_or(const mask a, const mask b){ return _mm256_or_ps(a, b); }
+    static inline mask mask_and_not(const mask a, const mask b){ return _mm256_andnot_ps(b, a); }
+    static inline int movemask(const mask a){ return _mm256_movemask_ps(a); }
+    static inline type abs(const type a){ return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static inline type multiply_sign(const type a, const type b){ return _mm256_xor_ps(a, _mm256_and_ps(b, _mm256_set1_ps(-0.0f))); }
+};
+#elif defined(__SSE2__)
+template <>
+struct SimdLanes<double>{
+    typedef __m128d type;
+    typedef __m128d mask;
+    static const int width = 2;
+
+    static inline type load(const double* p){ return _mm_loadu_pd(p); }
+    static inline void store(double* p, const type a){ _mm_storeu_pd(p, a); }
+    static inline type set(const double value){ return _mm_set1_pd(value); }
+    static inline type add(const type a, const type b){ return _mm_add_pd(a, b); }
+    static inline type sub(const type a, const type b){ return _mm_sub_pd(a, b); }
+    static inline type mul(const type a, const type b){ return _mm_mul_pd(a, b); }
+    static inline type div(const type a, const type b){ return _mm_div_pd(a, b); }
+    static inline mask less(const type a, const type b){ return _mm_cmplt_pd(a, b); }
+    static inline mask less_equal(const type a, const type b){ return _mm_cmple_pd(a, b); }
+    static inline mask equal(const type a, const type b){ return _mm_cmpeq_pd(a, b); }
+    static inline mask mask_and(const mask a, const mask b){ return _mm_and_pd(a, b); }
+    static inline mask mask_or(const mask a, const mask b){ return _mm_or_pd(a, b); }
+    static inline mask mask_and_not(const mask a, const mask b){ return _mm_andnot_pd(b, a); }
+    static inline int movemask(const mask a){ return _mm_movemask_pd(a); }
+    static inline type abs(const type a){ return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+    static inline type multiply_sign(const type a, const type b){ return _mm_xor_pd(a, _mm_and_pd(b, _mm_set1_pd(-0.0))); }
+};
+
+
+template <>
+struct SimdLanes<float>{
+    typedef __m128 type;
+    typedef __m128 mask;
+    static const int width = 4;
+
+    static inline type load(const float* p){ return _mm_loadu_ps(p); }
+    static inline void store(float* p, const type a){ _mm_storeu_ps(p, a); }
+    static inline type set(const float value){ return _mm_set1_ps(value); }
+    static inline type add(const type a, const type b){ return _mm_add_ps(a, b); }
+    static inline type sub(const type a, const type b){ return _mm_sub_ps(a, b); }
+    static inline type mul(const type a, const type b){ return _mm_mul_ps(a, b); }
+    static inline type div(const type a, const type b){ return _mm_div_ps(a, b); }
+    static inline mask less(const type a, const type b){ return _mm_cmplt_ps(a, b); }
+    static inline mask less_equal(const type a, const type b){ return _mm_cmple_ps(a, b); }
+    static inline mask equal(const type a, const type b){ return _mm_cmpeq_ps(a, b); }
+    static inline mask mask_and(const mask a, const mask b){ return _mm_and_ps(a, b); }
+    static inline mask mask_or(const mask a, const mask b){ return _mm_or_ps(a, b); }
+    static inline mask mask_and_not(const mask a, const mask b){ return _mm_andnot_ps(b, a); }
+    static inline int movemask(const mask a){ return _mm_movemask_ps(a); }
+    static inline type abs(const type a){ return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static inline type multiply_sign(const type a, const type b){ return _mm_xor_ps(a, _mm_and_ps(b, _mm_set1_ps(-0.0f))); }
+};
+#else
+template <class T>
+struct SimdLanes{
+    typedef T type;
+    typedef bool mask;
+    static const int width = 1;
+
+    static inline type load(const T* p){ return *p; }
+    static inline void store(T* p, const type a){ *p = a; }
+    static inline type set(const T value){ return value; }
+    static inline type add(const type a, const type b){ return a + b; }
+    static inline type sub(const type a, const type b){ return a - b; }
+    static inline type mul(const type a, const type b){ return a * b; }
+    static inline type div(const type a, const type b){ return a / b; }
+    static inline mask less(const type a, const type b){ return a < b; }
+    static inline mask less_equal(const type a, const type b){ return a <= b; }
+    static inline mask equal(const type a, const type b){ return a == b; }
+    static inline mask mask_and(const mask a, const mask b){ return a && b; }
+    static inline mask mask_or(const mask a, const mask b){ return a || b; }
+    static inline mask mask_and_not(const mask a, const mask b){ return a && !b; }
+    static inline int movemask(const mask a){ return a ? 1 : 0; }
+    static inline type abs(const type a){ return std::abs(a); }
+    static inline type multiply_sign(const type a, const type b){ return std::signbit(b) ? -a : a; }
+};
+#endif
+
+#endif
@@ -0,0 +1,194 @@
+#include "threadpool.h"
+#include <algorithm>
+#include <iostream>
+
+
+// Index of the worker running on the current thread, -1 for threads that do not belong to the pool.
+thread_local int current_worker_index = -1;
+
+
+bool TaskGroup::is_finished() const{
+    return pending_tasks.load(std::memory_order_acquire) == 0;
+}
+
+
+void WorkQueue::push(const Task& task){
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(task);
+}
+
+bool WorkQueue::pop(Task& task){
+    // The owning worker takes the most recently added task, which keeps its working set warm.
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tasks.empty()){
+        return false;
+    }
+    task = tasks.back();
+    tasks.pop_back();
+    return true;
+}
+
+bool WorkQueue::steal(Task& task){
+    // Other workers take the oldest task, which is usually the largest remaining piece of work.
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tasks.empty()){
+        return false;
+    }
+    task = tasks.front();
+    tasks.pop_front();
+    return true;
+}
+
+
+ThreadPool::ThreadPool(const int _number_of_threads) : queued_tasks(0), stop(false){
+    number_of_threads = std::max(_number_of_threads, 1);
+    for (int i = 0; i < number_of_threads; i++){
+        workers.push_back(new Worker());
+    }
+
+    // The thread creating the pool acts as worker 0 while it waits for tasks, so only number_of_threads - 1 threads are spawned.
+    current_worker_index = 0;
+    for (int i = 1; i < number_of_threads; i++){
+        threads.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+    }
+    reset_statistics();
+}
+
+ThreadPool::~ThreadPool(){
+    stop = true;
+    wake_condition.notify_all();
+    for (size_t i = 0; i < threads.size(); i++){
+        threads[i].join();
+    }
+    for (int i = 0; i < number_of_threads; i++){
+        delete workers[i];
+    }
+}
+
+int ThreadPool::get_number_of_threads() const { return number_of_threads; }
+int ThreadPool::get_worker_index() const { return current_worker_index; }
+
+void ThreadPool::run(TaskGroup& group, const std::function<void()>& function, const int worker_index){
+    Task task;
+    task.function = function;
+    task.group = &group;
+    group.pending_tasks.fetch_add(1, std::memory_order_relaxed);
+
+    int queue_index = worker_index;
+    if (queue_index < 0 || queue_index >= number_of_threads){
+        queue_index = std::max(current_worker_index, 0);
+    }
+    workers[queue_index] -> queue.push(task);
+    queued_tasks++;
+    wake_condition.notify_one();
+}
+
+bool ThreadPool::find_task(const int worker_index, Task& task, bool& stolen){
+    if (queued_tasks.load(std::memory_order_relaxed) == 0){
+        return false;
+    }
+
+    if (worker_index >= 0 && workers[worker_index] -> queue.pop(task)){
+        stolen = false;
+        queued_tasks--;
+        return true;
+    }
+
+    int start = std::max(worker_index, 0);
+    for (int i = 1; i <= number_of_threads; i++){
+        int victim = (start + i) % number_of_threads;
+        if (victim == worker_index){
+            continue;
+        }
+        if (workers[victim] -> queue.steal(task)){
+            stolen = true;
+            queued_tasks--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(const int worker_index, Task& task, const bool stolen){
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    task.function();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    if (worker_index >= 0){
+        WorkerStatistics& statistics = workers[worker_index] -> statistics;
+        statistics.busy_seconds += std::chrono::duration<double>(end - begin).count();
+        statistics.tasks_completed++;
+        if (stolen){
+            statistics.tasks_stolen++;
+        }
+    }
+    // Must be the last access to the task, the group may be destroyed as soon as it reaches zero.
+    task.group -> pending_tasks.fetch_sub(1, std::memory_order_release);
+}
+
+void ThreadPool::wait(TaskGroup& group){
+    // The waiting thread helps out instead of blocking, which also allows tasks to wait for tasks they spawn.
+    int worker_index = current_worker_index;
+    while (!group.is_finished()){
+        Task task;
+        bool stolen;
+        if (find_task(worker_index, task, stolen)){
+            execute(worker_index, task, stolen);
+        }
+        else{
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ThreadPool::parallel_for(const int number_of_items, const int chunk_size, const std::function<void(const int, const int, const int)>& function){
+    // Calls function(chunk_index, begin, end) for consecutive chunks of the items and waits for all of them. The chunk
+    // boundaries only depend on the chunk size, so per-chunk results can be combined in a deterministic order.
+    int size = std::max(chunk_size, 1);
+    int number_of_chunks = (number_of_items + size - 1) / size;
+    TaskGroup group;
+    for (int i = 0; i < number_of_chunks; i++){
+        int begin = i * size;
+        int end = std::min(begin + size, number_of_items);
+        run(group, [i, begin, end, &function](){
+            function(i, begin, end);
+        });
+    }
+    wait(group);
+}
+
+void ThreadPool::worker_loop(const int worker_index){
+    current_worker_index = worker_index;
+    while (!stop){
+        Task task;
+        bool stolen;
+        if (find_task(worker_index, task, stolen)){
+            execute(worker_index, task, stolen);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake_condition.wait_for(lock, std::chrono::milliseconds(1), [this](){ return stop || queued_tasks > 0; });
+    }
+}
+
+void ThreadPool::reset_statistics(){
+    for (int i = 0; i < number_of_threads; i++){
+        workers[i] -> statistics = WorkerStatistics();
+    }
+    statistics_start = std::chrono::steady_clock::now();
+}
+
+void ThreadPool::print_statistics() const{
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - statistics_start).count();
+    for (int i = 0; i < number_of_threads; i++){
+        const WorkerStatistics& statistics = workers[i] -> statistics;
+        double idle_seconds = std::max(elapsed - statistics.busy_seconds, 0.0);
+        std::clog << "Worker " << i << ": busy " << statistics.busy_seconds << "[s], idle " << idle_seconds << "[s], tasks " << statistics.tasks_completed << " (" << statistics.tasks_stolen << " stolen).\n";
+    }
+}
+
+
+ThreadPool& get_thread_pool(){
+    static ThreadPool thread_pool(std::thread::hardware_concurrency());
+    return thread_pool;
+}
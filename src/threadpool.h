@@ -0,0 +1,88 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class TaskGroup{
+    public:
+        TaskGroup() : pending_tasks(0) {}
+
+        bool is_finished() const;
+
+    private:
+        std::atomic<int> pending_tasks;
+
+        friend class ThreadPool;
+};
+
+
+struct Task{
+    std::function<void()> function;
+    TaskGroup* group = nullptr;
+};
+
+
+struct WorkerStatistics{
+    double busy_seconds = 0;
+    int tasks_completed = 0;
+    int tasks_stolen = 0;
+};
+
+
+class WorkQueue{
+    public:
+        void push(const Task& task);
+        bool pop(Task& task);
+        bool steal(Task& task);
+
+    private:
+        std::deque<Task> tasks;
+        std::mutex mutex;
+};
+
+
+class ThreadPool{
+    public:
+        ThreadPool(const int _number_of_threads);
+        ~ThreadPool();
+
+        int get_number_of_threads() const;
+        int get_worker_index() const;
+        void run(TaskGroup& group, const std::function<void()>& function, const int worker_index=-1);
+        void wait(TaskGroup& group);
+        void parallel_for(const int number_of_items, const int chunk_size, const std::function<void(const int, const int, const int)>& function);
+        void reset_statistics();
+        void print_statistics() const;
+
+    private:
+        struct Worker{
+            WorkQueue queue;
+            WorkerStatistics statistics;
+        };
+
+        int number_of_threads;
+        std::vector<Worker*> workers;
+        std::vector<std::thread> threads;
+        std::atomic<int> queued_tasks;
+        std::atomic<bool> stop;
+        std::mutex sleep_mutex;
+        std::condition_variable wake_condition;
+        std::chrono::steady_clock::time_point statistics_start;
+
+        bool find_task(const int worker_index, Task& task, bool& stolen);
+        void execute(const int worker_index, Task& task, const bool stolen);
+        void worker_loop(const int worker_index);
+};
+
+
+ThreadPool& get_thread_pool();
+
+#endif
@@ -0,0 +1,59 @@
+#include "transform.h"
+#include <stdexcept>
+
+
+Transform::Transform(){
+    rotation_rows[0] = vec3(1,0,0);
+    rotation_rows[1] = vec3(0,1,0);
+    rotation_rows[2] = vec3(0,0,1);
+    translation = vec3(0,0,0);
+    scale = 1;
+}
+
+Transform::Transform(const vec3& _translation, const vec3& rotation_axis, const double rotation_angle, const double _scale){
+    if (_scale <= 0){
+        throw std::invalid_argument("The scale of a transform must be positive!");
+    }
+    // Rodrigues' rotation formula, R = cos(a) I + sin(a) [k]x + (1 - cos(a)) k k^T.
+    vec3 k = normalize_vector(rotation_axis);
+    double c = cos(rotation_angle);
+    double s = sin(rotation_angle);
+    double t = 1 - c;
+    rotation_rows[0] = vec3(c + t * k[0] * k[0], t * k[0] * k[1] - s * k[2], t * k[0] * k[2] + s * k[1]);
+    rotation_rows[1] = vec3(t * k[1] * k[0] + s * k[2], c + t * k[1] * k[1], t * k[1] * k[2] - s * k[0]);
+    rotation_rows[2] = vec3(t * k[2] * k[0] - s * k[1], t * k[2] * k[1] + s * k[0], c + t * k[2] * k[2]);
+    translation = _translation;
+    scale = _scale;
+}
+
+double Transform::get_scale() const { return scale; }
+
+vec3 Transform::rotate(const vec3& vector) const{
+    return vec3(dot_vectors(rotation_rows[0], vector), dot_vectors(rotation_rows[1], vector), dot_vectors(rotation_rows[2], vector));
+}
+
+vec3 Transform::rotate_inverse(const vec3& vector) const{
+    // The inverse of a rotation is its transpose.
+    return rotation_rows[0] * vector[0] + rotation_rows[1] * vector[1] + rotation_rows[2] * vector[2];
+}
+
+vec3 Transform::point_to_world(const vec3& point) const{
+    return rotate(point * scale) + translation;
+}
+
+vec3 Transform::point_to_object(const vec3& point) const{
+    return rotate_inverse(point - translation) / scale;
+}
+
+vec3 Transform::vector_to_world(const vec3& vector) const{
+    return rotate(vector * scale);
+}
+
+vec3 Transform::vector_to_object(const vec3& vector) const{
+    return rotate_inverse(vector) / scale;
+}
+
+vec3 Transform::normal_to_world(const vec3& normal_vector) const{
+    // Uniform scaling does not change directions, so normals only need to be rotated.
+    return rotate(normal_vector);
+}
@@ -0,0 +1,31 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "vec3.h"
+
+
+class Transform{
+    // Scales uniformly, then rotates about an axis through the origin, then translates. Only similarity transforms are
+    // allowed, since they preserve angles and ratios of areas, so solid angle pdfs are the same in both spaces. The
+    // scale has to be positive, as a mirroring transform would turn the normals, which are only rotated, inside out.
+    public:
+        Transform();
+        Transform(const vec3& _translation, const vec3& rotation_axis, const double rotation_angle, const double _scale);
+
+        double get_scale() const;
+        vec3 point_to_world(const vec3& point) const;
+        vec3 point_to_object(const vec3& point) const;
+        vec3 vector_to_world(const vec3& vector) const;
+        vec3 vector_to_object(const vec3& vector) const;
+        vec3 normal_to_world(const vec3& normal_vector) const;
+
+    private:
+        vec3 rotation_rows[3];
+        vec3 translation;
+        double scale;
+
+        vec3 rotate(const vec3& vector) const;
+        vec3 rotate_inverse(const vec3& vector) const;
+};
+
+#endif
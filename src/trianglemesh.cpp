@@ -0,0 +1,510 @@
+#include "trianglemesh.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+
+void reorder_triangle_indices(std::vector<int>& indices, const std::vector<BVH::BuildPrimitive>& build_primitives){
+    if (indices.empty()){
+        return;
+    }
+    std::vector<int> ordered_indices(indices.size());
+    for (size_t i = 0; i < build_primitives.size(); i++){
+        for (int j = 0; j < 3; j++){
+            ordered_indices[3 * i + j] = indices[3 * build_primitives[i].index + j];
+        }
+    }
+    indices.swap(ordered_indices);
+}
+
+
+TriangleMesh::TriangleMesh(MeshData& data, Material* _material) : Object(_material){
+    positions = std::vector<vec3_t<geometry_scalar>>(data.positions.begin(), data.positions.end());
+    std::vector<vec3>().swap(data.positions);
+    position_indices.swap(data.position_indices);
+    UVs.swap(data.UVs);
+    normals.swap(data.normals);
+    UV_indices.swap(data.UV_indices);
+    normal_indices.swap(data.normal_indices);
+    number_of_triangles = position_indices.size() / 3;
+
+    // The BVH reorders the triangles, so it is built before anything refers to them by index.
+    std::vector<BVH::BuildPrimitive> build_primitives(number_of_triangles);
+    get_thread_pool().parallel_for(number_of_triangles, constants::bvh_parallel_chunk_size, [this, &build_primitives](const int, const int begin, const int end){
+        for (int i = begin; i < end; i++){
+            build_primitives[i].bounds = BVH::empty_box();
+            for (int j = 0; j < 3; j++){
+                BVH::grow_box(build_primitives[i].bounds, vertex(i, j));
+            }
+            build_primitives[i].centroid = (vertex(i, 0) + vertex(i, 1) + vertex(i, 2)) / 3.0;
+            build_primitives[i].index = i;
+        }
+    });
+    bvh = BVH::BoundingVolumeHierarchy<geometry_scalar>(build_primitives, TrianglePacket<geometry_scalar>::width);
+    reorder_triangle_indices(position_indices, build_primitives);
+    reorder_triangle_indices(UV_indices, build_primitives);
+    reorder_triangle_indices(normal_indices, build_primitives);
+    build_packets();
+
+    bounds_min = vec3(constants::max_ray_distance);
+    bounds_max = vec3(-constants::max_ray_distance);
+    for (size_t i = 0; i < position_indices.size(); i++){
+        vec3 position = vec3(positions[position_indices[i]]);
+        for (int j = 0; j < 3; j++){
+            bounds_min.e[j] = std::min(bounds_min[j], position[j]);
+            bounds_max.e[j] = std::max(bounds_max[j], position[j]);
+        }
+    }
+
+    area = 0;
+    for (int i = 0; i < number_of_triangles; i++){
+        area += triangle_area(i);
+    }
+
+    if (is_light_source()){
+        prepare_light_sampling();
+    }
+}
+
+TriangleMesh::TriangleMesh(CacheReader& reader, Material* _material) : Object(_material){
+    // The caller has to check the reader afterwards, since a mesh read from an invalid cache must not be used.
+    number_of_triangles = 0;
+    area = 0;
+    reader.read(number_of_triangles);
+    reader.read_vector(positions);
+    reader.read_vector(position_indices);
+    reader.read_vector(UVs);
+    reader.read_vector(normals);
+    reader.read_vector(UV_indices);
+    reader.read_vector(normal_indices);
+    reader.read(bounds_min);
+    reader.read(bounds_max);
+    reader.read(area);
+    bvh.read_cache(reader);
+    reader.read_vector(packets);
+
+    if (reader.is_valid() && !has_valid_indices()){
+        reader.invalidate();
+    }
+    if (reader.is_valid() && is_light_source()){
+        prepare_light_sampling();
+    }
+}
+
+bool has_valid_corners(const std::vector<int>& indices, const int number_of_elements, const bool allow_missing){
+    // Either all three corners of a triangle refer to an element, or, where allowed, all three are -1.
+    for (size_t i = 0; i < indices.size(); i += 3){
+        bool missing = indices[i] == -1 && indices[i+1] == -1 && indices[i+2] == -1;
+        if (missing && allow_missing){
+            continue;
+        }
+        for (int j = 0; j < 3; j++){
+            if (indices[i+j] < 0 || indices[i+j] >= number_of_elements){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool TriangleMesh::has_valid_indices() const{
+    // A cache with a matching header may still have been damaged, so everything that is used as an index later on is
+    // checked before the mesh is used.
+    size_t number_of_indices = 3 * size_t(std::max(number_of_triangles, 0));
+    if (number_of_triangles < 0 || position_indices.size() != number_of_indices){
+        return false;
+    }
+    if ((!UV_indices.empty() && UV_indices.size() != number_of_indices) || (!normal_indices.empty() && normal_indices.size() != number_of_indices)){
+        return false;
+    }
+    if (!has_valid_corners(position_indices, positions.size(), false) || !has_valid_corners(UV_indices, UVs.size(), true)
+        || !has_valid_corners(normal_indices, normals.size(), true)){
+        return false;
+    }
+
+    const int width = TrianglePacket<geometry_scalar>::width;
+    for (size_t i = 0; i < packets.size(); i++){
+        const TrianglePacket<geometry_scalar>& packet = packets[i];
+        if (packet.first_slot < 0 || packet.number_of_triangles < 1 || packet.number_of_triangles > width
+            || packet.first_slot > number_of_triangles - packet.number_of_triangles){
+            return false;
+        }
+    }
+
+    if (!bvh.has_valid_structure()){
+        return false;
+    }
+    std::vector<int> leaf_starts;
+    std::vector<int> leaf_counts;
+    bvh.get_leaves(leaf_starts, leaf_counts);
+    for (size_t i = 0; i < leaf_starts.size(); i++){
+        int number_of_leaf_packets = (leaf_counts[i] + width - 1) / width;
+        if (leaf_starts[i] < 0 || leaf_starts[i] > int(packets.size()) - number_of_leaf_packets){
+            return false;
+        }
+    }
+    return true;
+}
+
+void TriangleMesh::write_cache(CacheWriter& writer) const{
+    writer.write(number_of_triangles);
+    writer.write_vector(positions);
+    writer.write_vector(position_indices);
+    writer.write_vector(UVs);
+    writer.write_vector(normals);
+    writer.write_vector(UV_indices);
+    writer.write_vector(normal_indices);
+    writer.write(bounds_min);
+    writer.write(bounds_max);
+    writer.write(area);
+    bvh.write_cache(writer);
+    writer.write_vector(packets);
+}
+
+void TriangleMesh::prepare_light_sampling(){
+    cumulative_area.resize(number_of_triangles);
+    for (int i = 0; i < number_of_triangles; i++){
+        cumulative_area[i] = triangle_area(i) + (i == 0 ? 0 : cumulative_area[i-1]);
+    }
+    build_light_bvh();
+}
+
+void TriangleMesh::build_light_bvh(){
+    // Every triangle emits the same radiance, so its power is proportional to its area.
+    std::vector<LightBounds> lights(number_of_triangles);
+    for (int i = 0; i < number_of_triangles; i++){
+        lights[i].bounds = BVH::empty_box();
+        for (int j = 0; j < 3; j++){
+            BVH::grow_box(lights[i].bounds, vertex(i, j));
+        }
+        vec3 normal_vector = cross_vectors(vertex(i, 1) - vertex(i, 0), vertex(i, 2) - vertex(i, 0));
+        if (normal_vector.length_squared() > 0){
+            lights[i].axis = normalize_vector(normal_vector);
+            lights[i].cos_theta_o = 1;
+        }
+        else{
+            lights[i].axis = vec3(0, 0, 1);
+            lights[i].cos_theta_o = -1;
+        }
+        lights[i].power = triangle_area(i) * material -> average_emittance();
+    }
+    light_bvh = LightBVH(lights);
+}
+
+vec3 TriangleMesh::max_axis_point() const { return bounds_max; }
+vec3 TriangleMesh::min_axis_point() const { return bounds_min; }
+vec3 TriangleMesh::compute_centroid() const { return (bounds_min + bounds_max) / 2.0; }
+
+const vec3_t<geometry_scalar>& TriangleMesh::stored_vertex(const int primitive_ID, const int corner) const {
+    return positions[position_indices[3 * primitive_ID + corner]];
+}
+
+vec3 TriangleMesh::vertex(const int primitive_ID, const int corner) const {
+    return vec3(stored_vertex(primitive_ID, corner));
+}
+
+double TriangleMesh::triangle_area(const int primitive_ID) const {
+    return 0.5 * cross_vectors(vertex(primitive_ID, 1) - vertex(primitive_ID, 0), vertex(primitive_ID, 2) - vertex(primitive_ID, 0)).length();
+}
+
+vec3 TriangleMesh::compute_barycentric(const vec3& point, const int primitive_ID) const {
+    // The same projection onto the plane of the triangle as Triangle uses, computed on demand instead of stored.
+    vec3 p1 = vertex(primitive_ID, 0);
+    vec3 p2 = vertex(primitive_ID, 1);
+    vec3 p3 = vertex(primitive_ID, 2);
+    vec3 v1 = p2 - p1;
+    vec3 v2 = p3 - p1;
+    vec3 normal_vector = normalize_vector(cross_vectors(v1, v2));
+    v1 = normalize_vector(v1);
+    v2 = normalize_vector(cross_vectors(normal_vector, v1));
+
+    double x1 = dot_vectors(p1, v1);
+    double y1 = dot_vectors(p1, v2);
+    double x2 = dot_vectors(p2, v1);
+    double y2 = dot_vectors(p2, v2);
+    double x3 = dot_vectors(p3, v1);
+    double y3 = dot_vectors(p3, v2);
+    double det_T = (y2 - y3) * (x1 - x3) + (x3 - x2) * (y1 - y3);
+
+    double x = dot_vectors(point, v1);
+    double y = dot_vectors(point, v2);
+    double lambda1 = ((y2 - y3) * (x - x3) + (x3 - x2) * (y - y3)) / det_T;
+    double lambda2 = ((y3 - y1) * (x - x3) + (x1 - x3) * (y - y3)) / det_T;
+    return vec3(lambda1, lambda2, 1.0 - lambda1 - lambda2);
+}
+
+vec3 TriangleMesh::get_primitive_UV(const vec3& point, const int primitive_ID) const {
+    if (UV_indices.empty() || UV_indices[3 * primitive_ID] < 0){
+        return vec3(0, 0, 0);
+    }
+    vec3 barycentric_vector = compute_barycentric(point, primitive_ID);
+    const int* indices = &UV_indices[3 * primitive_ID];
+    return UVs[indices[0]] * barycentric_vector[0] + UVs[indices[1]] * barycentric_vector[1] + UVs[indices[2]] * barycentric_vector[2];
+}
+
+int TriangleMesh::get_number_of_triangles() const {
+    return number_of_triangles;
+}
+
+vec3 TriangleMesh::eval(const Hit& hit, const vec3& outgoing_vector) const {
+    vec3 UV = get_primitive_UV(hit.intersection_point, hit.primitive_ID);
+    return material -> eval(hit, outgoing_vector, UV[0], UV[1]);
+}
+
+BrdfData TriangleMesh::sample(const Hit& hit, Sampler& sampler) const {
+    vec3 UV = get_primitive_UV(hit.intersection_point, hit.primitive_ID);
+    return material -> sample(hit, UV[0], UV[1], sampler);
+}
+
+double TriangleMesh::brdf_pdf(const vec3& outgoing_vector, const Hit& hit) const {
+    vec3 UV = get_primitive_UV(hit.intersection_point, hit.primitive_ID);
+    return material -> brdf_pdf(outgoing_vector, hit.incident_vector, hit.normal_vector, UV[0], UV[1]);
+}
+
+vec3 TriangleMesh::get_light_emittance(const Hit& hit) const {
+    vec3 UV = get_primitive_UV(hit.intersection_point, hit.primitive_ID);
+    return material -> get_light_emittance(UV[0], UV[1]);
+}
+
+void TriangleMesh::build_packets(){
+    // The packets of a leaf are consecutive, and the BVH leaf then starts at its first packet instead of its first slot.
+    std::vector<int> leaf_starts;
+    std::vector<int> leaf_counts;
+    bvh.get_leaves(leaf_starts, leaf_counts);
+    const int width = TrianglePacket<geometry_scalar>::width;
+
+    std::vector<int> first_packets(leaf_starts.size());
+    int number_of_packets = 0;
+    for (size_t i = 0; i < leaf_starts.size(); i++){
+        first_packets[i] = number_of_packets;
+        number_of_packets += (leaf_counts[i] + width - 1) / width;
+    }
+
+    packets.resize(number_of_packets);
+    for (size_t i = 0; i < leaf_starts.size(); i++){
+        int leaf_end = leaf_starts[i] + leaf_counts[i];
+        TrianglePacket<geometry_scalar>* packet = &packets[first_packets[i]];
+        for (int first = leaf_starts[i]; first < leaf_end; first += width, packet++){
+            packet -> first_slot = first;
+            packet -> number_of_triangles = std::min(width, leaf_end - first);
+            for (int lane = 0; lane < packet -> number_of_triangles; lane++){
+                set_packet_triangle(*packet, lane, stored_vertex(first + lane, 0), stored_vertex(first + lane, 1), stored_vertex(first + lane, 2));
+            }
+        }
+    }
+    bvh.set_leaf_starts(first_packets);
+}
+
+double TriangleMesh::plane_distance(const int primitive_ID, const Ray& ray) const {
+    vec3 p1 = vertex(primitive_ID, 0);
+    vec3 normal_vector = cross_vectors(vertex(primitive_ID, 1) - p1, vertex(primitive_ID, 2) - p1);
+    return dot_vectors(normal_vector, p1 - ray.starting_position) / dot_vectors(normal_vector, ray.direction_vector);
+}
+
+bool TriangleMesh::intersect_packet(const TrianglePacket<geometry_scalar>& packet, Hit& hit, Ray& ray) const {
+    geometry_scalar distances[TrianglePacket<geometry_scalar>::width];
+    int uncertain_mask;
+    int hit_mask = intersect_triangle_packet(packet, ray, distances, uncertain_mask);
+
+    // Lanes are visited in slot order, so ties go to the same triangle as when testing one triangle at a time. Single
+    // precision distances are replaced by the distance to the plane of the triangle in double, to keep hit points as
+    // accurate as in double precision.
+    bool found_a_hit = false;
+    for (int lane = 0; lane < packet.number_of_triangles; lane++){
+        if (!((hit_mask | uncertain_mask) & (1 << lane))){
+            continue;
+        }
+        int slot = packet.first_slot + lane;
+        double distance = distances[lane];
+        bool success = true;
+        if (uncertain_mask & (1 << lane)){
+            success = intersect_triangle(stored_vertex(slot, 0), stored_vertex(slot, 1), stored_vertex(slot, 2), ray, distance);
+        }
+        else if (sizeof(geometry_scalar) < sizeof(double)){
+            distance = plane_distance(slot, ray);
+        }
+        if (success && distance > constants::EPSILON && distance < hit.distance){
+            hit.distance = distance;
+            hit.primitive_ID = slot;
+            ray.t_max = distance;
+            found_a_hit = true;
+        }
+    }
+    return found_a_hit;
+}
+
+bool TriangleMesh::find_closest_object_hit(Hit& hit, Ray& ray) const {
+    const int width = TrianglePacket<geometry_scalar>::width;
+    return bvh.intersect_leaves(ray, [this, &hit, width](const int start, const int count, Ray& ray){
+        bool found_a_hit = false;
+        int end_packet = start + (count + width - 1) / width;
+        for (int i = start; i < end_packet; i++){
+            if (intersect_packet(packets[i], hit, ray)){
+                found_a_hit = true;
+            }
+        }
+        return found_a_hit;
+    });
+}
+
+bool TriangleMesh::find_any_object_hit(Hit& hit, Ray& ray) const {
+    const int width = TrianglePacket<geometry_scalar>::width;
+    return bvh.occluded_leaves(ray, [this, &hit, width](const int start, const int count, Ray& ray){
+        int end_packet = start + (count + width - 1) / width;
+        for (int i = start; i < end_packet; i++){
+            if (intersect_packet(packets[i], hit, ray)){
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+vec3 TriangleMesh::get_normal_vector(const vec3& surface_point, const int primitive_ID) const {
+    if (normal_indices.empty() || normal_indices[3 * primitive_ID] < 0){
+        return normalize_vector(cross_vectors(vertex(primitive_ID, 1) - vertex(primitive_ID, 0), vertex(primitive_ID, 2) - vertex(primitive_ID, 0)));
+    }
+    vec3 barycentric_vector = compute_barycentric(surface_point, primitive_ID);
+    const int* indices = &normal_indices[3 * primitive_ID];
+    return normalize_vector(normals[indices[0]] * barycentric_vector[0] + normals[indices[1]] * barycentric_vector[1] + normals[indices[2]] * barycentric_vector[2]);
+}
+
+int TriangleMesh::sample_random_primitive_index(Sampler& sampler) const {
+    double random_area_split = sampler.random_uniform(0, cumulative_area.back());
+    int index = std::upper_bound(cumulative_area.begin(), cumulative_area.end(), random_area_split) - cumulative_area.begin();
+    return std::min(index, number_of_triangles - 1);
+}
+
+vec3 TriangleMesh::sample_triangle_point(const int primitive_ID, Sampler& sampler) const {
+    double r1 = sampler.random_uniform(0, 1);
+    double r2 = sampler.random_uniform(0, 1);
+    return vertex(primitive_ID, 0) * (1.0 - sqrt(r1)) + vertex(primitive_ID, 1) * (sqrt(r1) * (1.0 - r2)) + vertex(primitive_ID, 2) * (sqrt(r1) * r2);
+}
+
+vec3 TriangleMesh::generate_random_surface_point(Sampler& sampler) const {
+    return sample_triangle_point(sample_random_primitive_index(sampler), sampler);
+}
+
+double TriangleMesh::light_pdf(const vec3& surface_point, const vec3& intersection_point, const int primitive_id) const {
+    double triangle_pdf = light_bvh.pdf(intersection_point, primitive_id);
+    return std::abs(triangle_pdf / (triangle_area(primitive_id) * area_to_angle_PDF_factor(surface_point, intersection_point, primitive_id)));
+}
+
+vec3 TriangleMesh::random_light_point(const vec3& intersection_point, double& pdf, Sampler& sampler) const {
+    double triangle_pdf;
+    int random_index = light_bvh.sample(intersection_point, sampler.random_uniform(0, 1), triangle_pdf);
+    if (random_index == -1){
+        pdf = 0;
+        return vec3(0);
+    }
+    vec3 random_point = sample_triangle_point(random_index, sampler);
+    pdf = light_pdf(random_point, intersection_point, random_index);
+    return random_point;
+}
+
+
+vec3 compute_average_position(const vec3* vertex_array, const int number_of_vertices){
+    vec3 avg = vec3(0,0,0);
+    for (int i = 0; i < number_of_vertices; i++){
+        avg += vertex_array[i];
+    }
+    return avg / number_of_vertices;
+}
+
+
+double maximum_distance(const vec3& center, const vec3* vertex_array, const int number_of_vertices){
+    double max_distance = 0;
+    for (int i = 0; i < number_of_vertices; i++){
+        double distance = (vertex_array[i] - center).length();
+        if (distance > max_distance){
+            max_distance = distance;
+        }
+    }
+    return max_distance;
+}
+
+void change_vectors(const vec3& desired_center, const double desired_size, vec3* vertex_array, const int number_of_vertices){
+    vec3 average_position = compute_average_position(vertex_array, number_of_vertices);
+    double max_distance = maximum_distance(average_position, vertex_array, number_of_vertices);
+
+    for (int i = 0; i < number_of_vertices; i++){
+        vertex_array[i] = ((vertex_array[i] - average_position) / max_distance) * desired_size + desired_center;
+    }
+}
+
+
+uint64_t mesh_settings_hash(const bool enable_smooth_shading, const bool move_object, const vec3& center, const double size){
+    // Everything besides the model file that changes the processed mesh and its BVH, or how they are laid out.
+    uint64_t hash = hash_value(0, enable_smooth_shading);
+    hash = hash_value(hash, move_object);
+    for (int i = 0; i < 3; i++){
+        hash = hash_value(hash, center[i]);
+    }
+    hash = hash_value(hash, size);
+    hash = hash_value(hash, constants::bvh_width);
+    hash = hash_value(hash, constants::bvh_number_of_bins);
+    hash = hash_value(hash, constants::bvh_max_leaf_size);
+    hash = hash_value(hash, constants::bvh_traversal_cost);
+    hash = hash_value(hash, constants::bvh_intersection_cost);
+    hash = hash_value(hash, sizeof(geometry_scalar));
+    hash = hash_value(hash, sizeof(BVH::WideNode<geometry_scalar>));
+    hash = hash_value(hash, sizeof(TrianglePacket<geometry_scalar>));
+    return hash;
+}
+
+
+TriangleMesh* load_cached_mesh(const std::string& cache_name, const uint64_t source_hash, const uint64_t settings_hash, Material* material){
+    // Returns nullptr if there is no usable cache. The arrays are copied from the mapping into the vectors of the mesh,
+    // so the mapping is released once the mesh is read.
+    MappedFile cache_file(cache_name);
+    if (!cache_file.is_open()){
+        return nullptr;
+    }
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    CacheReader reader(cache_file.begin(), cache_file.end());
+    if (!reader.read_header(MESH_CACHE, source_hash, settings_hash)){
+        std::clog << "Scene cache " << cache_name << " is out of date.\n";
+        return nullptr;
+    }
+
+    TriangleMesh* cached_object = new TriangleMesh(reader, material);
+    if (!reader.is_valid() || !reader.is_at_end()){
+        std::clog << "Scene cache " << cache_name << " is damaged.\n";
+        delete cached_object;
+        return nullptr;
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    std::clog << "Loaded " << cached_object -> get_number_of_triangles() << " triangles from " << cache_name << " in "
+              << std::chrono::duration<double>(end - begin).count() << "[s].\n";
+    return cached_object;
+}
+
+
+TriangleMesh* load_object_model(std::string file_name, Material* material, const bool enable_smooth_shading, const bool move_object, const vec3& center, const double size){
+    // With the scene cache enabled, the mesh is read from a cache next to the model file when there is one for the same
+    // file contents and settings, and the cache is written after loading the model otherwise.
+    uint64_t source_hash = 0;
+    uint64_t settings_hash = mesh_settings_hash(enable_smooth_shading, move_object, center, size);
+    bool use_cache = constants::enable_scene_cache && hash_file(file_name, source_hash);
+    if (use_cache){
+        TriangleMesh* cached_object = load_cached_mesh(cache_file_name(file_name), source_hash, settings_hash, material);
+        if (cached_object){
+            return cached_object;
+        }
+    }
+
+    MeshData data;
+    parse_object_file(file_name, data, enable_smooth_shading);
+
+    if (move_object){
+        change_vectors(center, size, data.positions.data(), data.positions.size());
+    }
+
+    TriangleMesh* loaded_object = new TriangleMesh(data, material);
+    if (use_cache){
+        CacheWriter writer(cache_file_name(file_name), MESH_CACHE, source_hash, settings_hash);
+        loaded_object -> write_cache(writer);
+        writer.close();
+    }
+    return loaded_object;
+}
@@ -0,0 +1,97 @@
+#ifndef TRIANGLEMESH_H
+#define TRIANGLEMESH_H
+
+#include <string>
+#include <vector>
+#include "constants.h"
+#include "vec3.h"
+#include "utils.h"
+#include "materials.h"
+#include "objects.h"
+#include "bvh.h"
+#include "trianglepacket.h"
+#include "lightbvh.h"
+#include "objloader.h"
+#include "scenecache.h"
+
+
+struct MeshData{
+    // Shared vertex attributes and three indices into them per triangle. A triangle without UVs or normals has -1 as its
+    // indices, and the index arrays are left empty when no triangle has any.
+    std::vector<vec3> positions;
+    std::vector<vec3> UVs;
+    std::vector<vec3> normals;
+    std::vector<int> position_indices;
+    std::vector<int> UV_indices;
+    std::vector<int> normal_indices;
+};
+
+
+class TriangleMesh : public Object{
+    // Triangles stored as indices into shared vertex buffers instead of as separate objects. Everything else about a
+    // triangle is derived from its vertices when it is needed. For intersection, the triangles of every BVH leaf are
+    // also copied into packets, which are tested against a ray with one SIMD kernel. The BVH leaves refer to their first
+    // packet rather than their first triangle. Emissive meshes also keep a light BVH over their triangles, so that light
+    // samples favour the triangles that face and are close to the shading point. A mesh can also be read back from a
+    // scene cache, which stores everything but what depends on the material.
+    public:
+        TriangleMesh(MeshData& data, Material* _material);
+        TriangleMesh(CacheReader& reader, Material* _material);
+
+        virtual vec3 max_axis_point() const override;
+        virtual vec3 min_axis_point() const override;
+        virtual vec3 compute_centroid() const override;
+        virtual vec3 eval(const Hit& hit, const vec3& outgoing_vector) const override;
+        virtual BrdfData sample(const Hit& hit, Sampler& sampler) const override;
+        virtual double brdf_pdf(const vec3& outgoing_vector, const Hit& hit) const override;
+        virtual vec3 get_light_emittance(const Hit& hit) const override;
+        virtual bool find_closest_object_hit(Hit& hit, Ray& ray) const override;
+        virtual bool find_any_object_hit(Hit& hit, Ray& ray) const override;
+        virtual vec3 get_normal_vector(const vec3& surface_point, const int primitive_ID) const override;
+        vec3 get_primitive_UV(const vec3& point, const int primitive_ID) const;
+        int get_number_of_triangles() const;
+        virtual vec3 generate_random_surface_point(Sampler& sampler) const override;
+        virtual double light_pdf(const vec3& surface_point, const vec3& intersection_point, const int primitive_id) const override;
+        virtual vec3 random_light_point(const vec3& intersection_point, double& inverse_PDF, Sampler& sampler) const override;
+        void write_cache(CacheWriter& writer) const;
+
+    private:
+        int number_of_triangles;
+        std::vector<vec3_t<geometry_scalar>> positions;
+        std::vector<int> position_indices;
+        std::vector<vec3> UVs;
+        std::vector<vec3> normals;
+        std::vector<int> UV_indices;
+        std::vector<int> normal_indices;
+        std::vector<double> cumulative_area; // Only filled for emissive meshes.
+        LightBVH light_bvh; // Only built for emissive meshes.
+        vec3 bounds_min;
+        vec3 bounds_max;
+        BVH::BoundingVolumeHierarchy<geometry_scalar> bvh;
+        std::vector<TrianglePacket<geometry_scalar>> packets;
+
+        const vec3_t<geometry_scalar>& stored_vertex(const int primitive_ID, const int corner) const;
+        vec3 vertex(const int primitive_ID, const int corner) const;
+        double triangle_area(const int primitive_ID) const;
+        vec3 compute_barycentric(const vec3& point, const int primitive_ID) const;
+        void build_packets();
+        bool has_valid_indices() const;
+        void prepare_light_sampling();
+        void build_light_bvh();
+        bool intersect_packet(const TrianglePacket<geometry_scalar>& packet, Hit& hit, Ray& ray) const;
+        double plane_distance(const int primitive_ID, const Ray& ray) const;
+        int sample_random_primitive_index(Sampler& sampler) const;
+        vec3 sample_triangle_point(const int primitive_ID, Sampler& sampler) const;
+};
+
+
+void reorder_triangle_indices(std::vector<int>& indices, const std::vector<BVH::BuildPrimitive>& build_primitives);
+vec3 compute_average_position(const vec3* vertex_array, const int number_of_vertices);
+double maximum_distance(const vec3& center, const vec3* vertex_array, const int number_of_vertices);
+void change_vectors(const vec3& desired_center, const double desired_size, vec3* vertex_array, const int number_of_vertices);
+bool has_valid_corners(const std::vector<int>& indices, const int number_of_elements, const bool allow_missing);
+uint64_t mesh_settings_hash(const bool enable_smooth_shading, const bool move_object, const vec3& center, const double size);
+TriangleMesh* load_cached_mesh(const std::string& cache_name, const uint64_t source_hash, const uint64_t settings_hash, Material* material);
+TriangleMesh* load_object_model(std::string file_name, Material* material, const bool enable_smooth_shading, const bool move_object, const vec3& center, const double size);
+
+#endif
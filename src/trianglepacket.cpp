@@ -0,0 +1,80 @@
+#include "trianglepacket.h"
+
+
+template <class T>
+void set_packet_triangle(TrianglePacket<T>& packet, const int lane, const vec3_t<T>& p1, const vec3_t<T>& p2, const vec3_t<T>& p3){
+    for (int axis = 0; axis < 3; axis++){
+        packet.vertices[0][axis][lane] = p1[axis];
+        packet.vertices[1][axis][lane] = p2[axis];
+        packet.vertices[2][axis][lane] = p3[axis];
+    }
+}
+
+
+template <class T>
+int intersect_triangle_packet(const TrianglePacket<T>& packet, const Ray& ray, T* distances, int& uncertain_mask){
+    // The watertight test of intersect_triangle, run on all triangles of the packet at once. Returns a bit mask of the
+    // lanes that are hit in front of the origin and before ray.t_max, with their distances. In single precision, lanes
+    // with an edge function of exactly zero are left to the scalar test and marked in uncertain_mask instead.
+    typedef SimdLanes<T> S;
+    typedef typename S::type V;
+    typedef typename S::mask M;
+
+    const V origin_x = S::set(T(ray.starting_position[ray.kx]));
+    const V origin_y = S::set(T(ray.starting_position[ray.ky]));
+    const V origin_z = S::set(T(ray.starting_position[ray.kz]));
+    const V shear_x = S::set(T(ray.Sx));
+    const V shear_y = S::set(T(ray.Sy));
+    const V shear_z = S::set(T(ray.Sz));
+    const V zero = S::set(0);
+    const V t_max = S::set(T(ray.t_max));
+
+    int hit_mask = 0;
+    uncertain_mask = 0;
+    for (int lane = 0; lane < packet.number_of_triangles; lane += S::width){
+        V x[3];
+        V y[3];
+        V z[3];
+        for (int i = 0; i < 3; i++){
+            V translated_x = S::sub(S::load(&packet.vertices[i][ray.kx][lane]), origin_x);
+            V translated_y = S::sub(S::load(&packet.vertices[i][ray.ky][lane]), origin_y);
+            V translated_z = S::sub(S::load(&packet.vertices[i][ray.kz][lane]), origin_z);
+            x[i] = S::add(translated_x, S::mul(shear_x, translated_z));
+            y[i] = S::add(translated_y, S::mul(shear_y, translated_z));
+            z[i] = S::mul(translated_z, shear_z);
+        }
+
+        V e1 = S::sub(S::mul(x[1], y[2]), S::mul(y[1], x[2]));
+        V e2 = S::sub(S::mul(x[2], y[0]), S::mul(y[2], x[0]));
+        V e3 = S::sub(S::mul(x[0], y[1]), S::mul(y[0], x[1]));
+
+        M any_negative = S::mask_or(S::mask_or(S::less(e1, zero), S::less(e2, zero)), S::less(e3, zero));
+        M any_positive = S::mask_or(S::mask_or(S::less(zero, e1), S::less(zero, e2)), S::less(zero, e3));
+        M outside = S::mask_and(any_negative, any_positive);
+
+        V det = S::add(S::add(e1, e2), e3);
+        V t_scaled = S::add(S::add(S::mul(e1, z[0]), S::mul(e2, z[1])), S::mul(e3, z[2]));
+
+        // Flipping both signs by the sign of det turns the two cases of the scalar test into one.
+        V signed_t_scaled = S::multiply_sign(t_scaled, det);
+        V abs_det = S::abs(det);
+        M in_range = S::mask_and(S::less(zero, signed_t_scaled), S::less_equal(signed_t_scaled, S::mul(t_max, abs_det)));
+        M hit = S::mask_and_not(S::mask_and(S::less(zero, abs_det), in_range), outside);
+
+        S::store(distances + lane, S::div(signed_t_scaled, abs_det));
+        hit_mask |= S::movemask(hit) << lane;
+        if (sizeof(T) < sizeof(double)){
+            M on_edge = S::mask_or(S::mask_or(S::equal(e1, zero), S::equal(e2, zero)), S::equal(e3, zero));
+            uncertain_mask |= S::movemask(on_edge) << lane;
+        }
+    }
+    int lane_mask = (1 << packet.number_of_triangles) - 1;
+    uncertain_mask &= lane_mask;
+    return hit_mask & lane_mask & ~uncertain_mask;
+}
+
+
+template void set_packet_triangle<double>(TrianglePacket<double>& packet, const int lane, const vec3& p1, const vec3& p2, const vec3& p3);
+template void set_packet_triangle<float>(TrianglePacket<float>& packet, const int lane, const vec3f& p1, const vec3f& p2, const vec3f& p3);
+template int intersect_triangle_packet<double>(const TrianglePacket<double>& packet, const Ray& ray, double* distances, int& uncertain_mask);
+template int intersect_triangle_packet<float>(const TrianglePacket<float>& packet, const Ray& ray, float* distances, int& uncertain_mask);
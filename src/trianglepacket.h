@@ -0,0 +1,27 @@
+#ifndef TRIANGLEPACKET_H
+#define TRIANGLEPACKET_H
+
+#include "vec3.h"
+#include "utils.h"
+#include "simd.h"
+
+
+template <class T>
+struct TrianglePacket{
+    // Up to width triangles of one BVH leaf. Coordinates are stored as vertices[vertex][axis][lane], so every load in the
+    // kernel fetches the same coordinate of all triangles, and the permutation of the watertight test only picks which
+    // axis to load. Lanes from number_of_triangles on are unused.
+    static const int width = sizeof(T) == sizeof(float) ? 8 : 4;
+    T vertices[3][3][width];
+    int first_slot;
+    int number_of_triangles;
+};
+
+
+template <class T>
+void set_packet_triangle(TrianglePacket<T>& packet, const int lane, const vec3_t<T>& p1, const vec3_t<T>& p2, const vec3_t<T>& p3);
+
+template <class T>
+int intersect_triangle_packet(const TrianglePacket<T>& packet, const Ray& ray, T* distances, int& uncertain_mask);
+
+#endif
@@ -2,30 +2,9 @@
 #define UTILS_H
 #include "vec3.h"
 #include "constants.h"
-#include <random>
+#include "sampler.h"
 #include <complex>
 
-std::random_device rand_dev_normal;
-std::minstd_rand normal_generator(rand_dev_normal());
-std::normal_distribution<double> normal_distribution(0, 1);
-
-std::random_device rand_dev_uniform;
-std::minstd_rand uniform_generator(rand_dev_uniform());
-std::uniform_real_distribution<double> uniform_dist(0, 1);
-
-double random_uniform(const double low, const double high){
-    return (high - low) * uniform_dist(uniform_generator) + low;
-}
-
-int random_int(const int low, const int high){
-    // Returns a random int between low (inclusive) and high (exclusive).
-    return (int) random_uniform(low, high);
-}
-
-double random_normal(){
-    return normal_distribution(normal_generator);
-}
-
 double pos_fmod(const double a, const double b){
     return fmod((fmod(a, b) + b), b);
 }
@@ -60,17 +39,17 @@ bool solve_quadratic(const double b, const double c, double& distance){
 
 }
 
-vec3 sample_spherical(){
-    double r1 = random_normal();
-    double r2 = random_normal();
-    double r3 = random_normal();
+vec3 sample_spherical(Sampler& sampler){
+    double r1 = sampler.random_normal();
+    double r2 = sampler.random_normal();
+    double r3 = sampler.random_normal();
     vec3 sample = vec3(r1, r2, r3);
     sample = normalize_vector(sample);
     return sample;
 }
 
-vec3 sample_hemisphere(const vec3& normal){
-    vec3 sample = sample_spherical();
+vec3 sample_hemisphere(const vec3& normal, Sampler& sampler){
+    vec3 sample = sample_spherical(sampler);
     if (dot_vectors(normal, sample) < 0){
         return -sample;
     }
@@ -89,12 +68,12 @@ void set_perpendicular_vectors(const vec3& z_hat, vec3& x_hat, vec3& y_hat){
     y_hat = normalize_vector(y_hat);
 }
 
-vec3 sample_angled_hemisphere(const vec3& normal_vector, const double cos_max){
+vec3 sample_angled_hemisphere(const vec3& normal_vector, const double cos_max, Sampler& sampler){
     vec3 x_hat;
     vec3 y_hat;
     set_perpendicular_vectors(normal_vector, x_hat, y_hat);
-    double phi = random_uniform(0, 2.0 * M_PI);
-    double cos_theta = random_uniform(cos_max, 1);
+    double phi = sampler.random_uniform(0, 2.0 * M_PI);
+    double cos_theta = sampler.random_uniform(cos_max, 1);
     double sin_theta = sqrt(1 - (cos_theta * cos_theta));
     double x = sin_theta * cos(phi);
     double y = sin_theta * sin(phi);
@@ -102,13 +81,13 @@ vec3 sample_angled_hemisphere(const vec3& normal_vector, const double cos_max){
     return x_hat * x + y_hat * y + normal_vector * z;
 }
 
-vec3 sample_cosine_hemisphere(const vec3& normal_vector){
+vec3 sample_cosine_hemisphere(const vec3& normal_vector, Sampler& sampler){
     vec3 x_hat;
     vec3 y_hat;
     set_perpendicular_vectors(normal_vector, x_hat, y_hat);
 
-    double theta = ((double) rand() / (RAND_MAX)) * 2 * M_PI;
-    double radius = sqrt((double) rand() / (RAND_MAX));
+    double theta = sampler.random_uniform(0, 2.0 * M_PI);
+    double radius = sqrt(sampler.random_uniform(0, 1));
     double x = cos(theta) * radius;
     double y = sin(theta) * radius;
     double z = sqrt(1 - x * x - y * y);
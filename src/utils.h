@@ -3,13 +3,14 @@
 
 #include "vec3.h"
 #include "constants.h"
-#include <random>
+#include "sampler.h"
 #include <complex>
+#include <type_traits>
 
 
-double random_uniform(const double low, const double high);
-int random_int(const int low, const int high);
-double random_normal();
+// Scalar of mesh vertices, BVH boxes and triangle tests. Shading and accumulation stay in double either way.
+typedef std::conditional<constants::enable_single_precision_geometry, float, double>::type geometry_scalar;
+
 
 enum reflection_type{
     DIFFUSE = 0,
@@ -39,6 +40,7 @@ struct Ray{
     double Sx;
     double Sy;
     double Sz;
+    vec3 inverse_direction;
 
     void prepare(){
         kz = argmax(abs(direction_vector));
@@ -57,6 +59,8 @@ struct Ray{
         Sx = -d[0]/ d[2];
         Sy = -d[1] / d[2];
         Sz = 1.0 / d[2];
+
+        inverse_direction = vec3(1.0 / direction_vector[0], 1.0 / direction_vector[1], 1.0 / direction_vector[2]);
     }
 };
 
@@ -66,11 +70,11 @@ double clamp(const double value, const double min, const double max);
 double sign(const double x);
 bool solve_quadratic(const double b, const double c, double& distance);
 
-vec3 sample_spherical();
-vec3 sample_hemisphere(const vec3& normal);
+vec3 sample_spherical(Sampler& sampler);
+vec3 sample_hemisphere(const vec3& normal, Sampler& sampler);
 void set_perpendicular_vectors(const vec3& z_hat, vec3& x_hat, vec3& y_hat);
-vec3 sample_angled_hemisphere(const vec3& normal_vector, const double cos_max);
-vec3 sample_cosine_hemisphere(const vec3& normal_vector);
+vec3 sample_angled_hemisphere(const vec3& normal_vector, const double cos_max, Sampler& sampler);
+vec3 sample_cosine_hemisphere(const vec3& normal_vector, Sampler& sampler);
 vec3 reflect_vector(const vec3& direction_vector, const vec3& normal_vector);
 vec3 refract_vector(const vec3& incident_vector, const vec3& normal_vector, const double eta);
 
@@ -1,4 +1,10 @@
 #include "valuemap.h"
+#include "scenecache.h"
+#include "objloader.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
 
 
 ValueMap::ValueMap(const int _data, const int _width, const int _height, const double _u_max, const double _v_max){
@@ -19,6 +25,9 @@ ValueMap::~ValueMap(){
     delete[] data;
 }
 
+int ValueMap::get_width() const { return width; }
+int ValueMap::get_height() const { return height; }
+
 void ValueMap::initialise(double* _data, const int _width, const int _height, const double _u_max, const double _v_max){
     data = _data;
     width = _width;
@@ -38,6 +47,14 @@ double ValueMap1D::get(const double u, const double v) const {
     return data[index];
 }
 
+double ValueMap1D::average() const {
+    double sum = 0;
+    for (int i = 0; i < width * height; i++){
+        sum += data[i];
+    }
+    return sum / (width * height);
+}
+
 vec3 ValueMap3D::get(const double u, const double v) const {
     if (isnan(u) || isnan(v)){
         return vec3(0,0,0);
@@ -48,14 +65,27 @@ vec3 ValueMap3D::get(const double u, const double v) const {
     return vec3(data[start_index], data[start_index + 1], data[start_index + 2]);
 }
 
+vec3 ValueMap3D::get_texel(const int x, const int y) const {
+    int start_index = 3 * (y * width + x);
+    return vec3(data[start_index], data[start_index + 1], data[start_index + 2]);
+}
 
-ValueMap1D* create_value_map_1D(const char* file_name, double u_max, double v_max) {
+vec3 ValueMap3D::average() const {
+    vec3 sum = vec3(0,0,0);
+    for (int i = 0; i < width * height; i++){
+        sum += vec3(data[3*i], data[3*i + 1], data[3*i + 2]);
+    }
+    return sum / (width * height);
+}
+
+
+double* parse_value_map_file(const char* file_name, int& width, int& height, int& dimension) {
+    // The text format is the width, height and dimension, followed by all values.
     FILE* map_file = fopen(file_name, "r");
     if (!map_file) {
         return nullptr;
     }
 
-    int width, height, dimension;
     if (fscanf(map_file, "%d %d %d", &width, &height, &dimension) != 3) {
         fclose(map_file);
         return nullptr;
@@ -69,29 +99,67 @@ ValueMap1D* create_value_map_1D(const char* file_name, double u_max, double v_ma
     }
 
     fclose(map_file);
-    return new ValueMap1D(data_array, width, height, u_max, v_max);
+    return data_array;
 }
 
 
-ValueMap3D* create_value_map_3D(const char* file_name, double u_max, double v_max) {
-    FILE* map_file = fopen(file_name, "r");
-    if (!map_file) {
-        return nullptr;
+double* read_value_map_data(const char* file_name, int& width, int& height, int& dimension) {
+    // Parsing the text is by far the slowest part of loading a map, so with the scene cache enabled the values are
+    // read from a cache next to the file when there is one for the same file contents, and written there otherwise.
+    uint64_t source_hash = 0;
+    // The values depend on nothing but the file.
+    uint64_t settings_hash = 0;
+    std::string cache_name = cache_file_name(file_name);
+    bool use_cache = constants::enable_scene_cache && hash_file(file_name, source_hash);
+    if (use_cache) {
+        MappedFile cache_file(cache_name);
+        CacheReader reader(cache_file.begin(), cache_file.end());
+        std::vector<double> values;
+        if (cache_file.is_open() && !reader.read_header(VALUE_MAP_CACHE, source_hash, settings_hash)) {
+            std::clog << "Scene cache " << cache_name << " is out of date.\n";
+        }
+        else if (cache_file.is_open()) {
+            reader.read(width);
+            reader.read(height);
+            reader.read(dimension);
+            reader.read_vector(values);
+            if (reader.is_valid() && reader.is_at_end() && values.size() == size_t(width) * height * dimension) {
+                double* data_array = new double[values.size()];
+                std::copy(values.begin(), values.end(), data_array);
+                return data_array;
+            }
+            std::clog << "Scene cache " << cache_name << " is damaged.\n";
+        }
     }
 
+    double* data_array = parse_value_map_file(file_name, width, height, dimension);
+    if (data_array && use_cache) {
+        CacheWriter writer(cache_name, VALUE_MAP_CACHE, source_hash, settings_hash);
+        writer.write(width);
+        writer.write(height);
+        writer.write(dimension);
+        writer.write_vector(std::vector<double>(data_array, data_array + width * height * dimension));
+        writer.close();
+    }
+    return data_array;
+}
+
+
+ValueMap1D* create_value_map_1D(const char* file_name, double u_max, double v_max) {
     int width, height, dimension;
-    if (fscanf(map_file, "%d %d %d", &width, &height, &dimension) != 3) {
-        fclose(map_file);
+    double* data_array = read_value_map_data(file_name, width, height, dimension);
+    if (!data_array) {
         return nullptr;
     }
+    return new ValueMap1D(data_array, width, height, u_max, v_max);
+}
 
-    int N = width * height * dimension;
-    double* data_array = new double[N];
 
-    for (int i = 0; i < N; i++) {
-        fscanf(map_file, "%lf", &data_array[i]);
+ValueMap3D* create_value_map_3D(const char* file_name, double u_max, double v_max) {
+    int width, height, dimension;
+    double* data_array = read_value_map_data(file_name, width, height, dimension);
+    if (!data_array) {
+        return nullptr;
     }
-
-    fclose(map_file);
     return new ValueMap3D(data_array, width, height, u_max, v_max);
 }
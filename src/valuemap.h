@@ -14,6 +14,9 @@ class ValueMap{
         ValueMap(double* _data, const int _width=1, const int _height=1, const double _u_max=1, const double _v_max=1);
         ~ValueMap();
 
+        int get_width() const;
+        int get_height() const;
+
     protected:
         double* data;
         int width;
@@ -29,6 +32,7 @@ class ValueMap1D : public ValueMap{
         using ValueMap::ValueMap;
 
         double get(const double u, const double v) const;
+        double average() const;
 };
 
 
@@ -37,9 +41,13 @@ class ValueMap3D : public ValueMap{
         using ValueMap::ValueMap;
 
         vec3 get(const double u, const double v) const;
+        vec3 get_texel(const int x, const int y) const;
+        vec3 average() const;
 };
 
 
+double* parse_value_map_file(const char* file_name, int& width, int& height, int& dimension);
+double* read_value_map_data(const char* file_name, int& width, int& height, int& dimension);
 ValueMap1D* create_value_map_1D(const char* file_name, double u_max = 1, double v_max = 1);
 ValueMap3D* create_value_map_3D(const char* file_name, double u_max = 1, double v_max = 1);
 #endif
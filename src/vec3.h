@@ -5,122 +5,129 @@
 #include <iostream>
 
 
-class vec3 {
+template <class T>
+class vec3_t {
+    // Three component vector over a scalar type. Shading works in double, while geometry can be stored and intersected
+    // in float, see geometry_scalar.
     public:
-        double e[3];
+        typedef T scalar;
+        T e[3];
 
-        vec3() : e{0,0,0} {}
+        vec3_t() : e{0,0,0} {}
 
-        vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
-        vec3(double e) : e{e, e, e} {}
+        vec3_t(T e0, T e1, T e2) : e{e0, e1, e2} {}
+        vec3_t(T e) : e{e, e, e} {}
 
-        inline vec3 operator-() const {
-            return vec3(-e[0], -e[1], -e[2]);
+        template <class U>
+        explicit vec3_t(const vec3_t<U>& v) : e{T(v[0]), T(v[1]), T(v[2])} {}
+
+        inline vec3_t operator-() const {
+            return vec3_t(-e[0], -e[1], -e[2]);
         }
 
-        inline vec3 operator+(const vec3 &v2) const{
-            double e0 = e[0] + v2[0];
-            double e1 = e[1] + v2[1];
-            double e2 = e[2] + v2[2];
-            return vec3(e0, e1, e2);
+        inline vec3_t operator+(const vec3_t &v2) const{
+            T e0 = e[0] + v2[0];
+            T e1 = e[1] + v2[1];
+            T e2 = e[2] + v2[2];
+            return vec3_t(e0, e1, e2);
         }
 
-        inline vec3& operator+=(const vec3 &v2){
+        inline vec3_t& operator+=(const vec3_t &v2){
             e[0] += v2[0];
             e[1] += v2[1];
             e[2] += v2[2];
             return *this;
         }
 
-        inline vec3 operator-(const vec3 &v2) const{
-            double e0 = e[0] - v2[0];
-            double e1 = e[1] - v2[1];
-            double e2 = e[2] - v2[2];
-            return vec3(e0, e1, e2);
+        inline vec3_t operator-(const vec3_t &v2) const{
+            T e0 = e[0] - v2[0];
+            T e1 = e[1] - v2[1];
+            T e2 = e[2] - v2[2];
+            return vec3_t(e0, e1, e2);
         }
 
-        inline vec3& operator-=(const vec3 &v2){
+        inline vec3_t& operator-=(const vec3_t &v2){
             e[0] -= v2[0];
             e[1] -= v2[1];
             e[2] -= v2[2];
             return *this;
         }
 
-        inline vec3 operator*(const vec3 &v2) const{
-            double e0 = e[0] * v2[0];
-            double e1 = e[1] * v2[1];
-            double e2 = e[2] * v2[2];
-            return vec3(e0, e1, e2);
+        inline vec3_t operator*(const vec3_t &v2) const{
+            T e0 = e[0] * v2[0];
+            T e1 = e[1] * v2[1];
+            T e2 = e[2] * v2[2];
+            return vec3_t(e0, e1, e2);
         }
 
-        inline vec3 operator*(const double value) const{
-            double e0 = e[0] * value;
-            double e1 = e[1] * value;
-            double e2 = e[2] * value;
-            return vec3(e0, e1, e2);
+        inline vec3_t operator*(const T value) const{
+            T e0 = e[0] * value;
+            T e1 = e[1] * value;
+            T e2 = e[2] * value;
+            return vec3_t(e0, e1, e2);
         }
 
-        inline vec3& operator*=(const vec3& v2){
+        inline vec3_t& operator*=(const vec3_t& v2){
             e[0] *= v2[0];
             e[1] *= v2[1];
             e[2] *= v2[2];
             return *this;
         }
 
-        inline vec3& operator*=(const double value){
+        inline vec3_t& operator*=(const T value){
             e[0] *= value;
             e[1] *= value;
             e[2] *= value;
             return *this;
         }
 
-        inline vec3& operator/=(const double value){
+        inline vec3_t& operator/=(const T value){
             e[0] /= value;
             e[1] /= value;
             e[2] /= value;
             return *this;
         }
 
-        inline vec3 operator/(const double value) const{
-            double e0 = e[0] / value;
-            double e1 = e[1] / value;
-            double e2 = e[2] / value;
-            return vec3(e0, e1, e2);
+        inline vec3_t operator/(const T value) const{
+            T e0 = e[0] / value;
+            T e1 = e[1] / value;
+            T e2 = e[2] / value;
+            return vec3_t(e0, e1, e2);
         }
 
-        inline vec3 operator/(const vec3& v) const{
-            double e0 = e[0] / v[0];
-            double e1 = e[1] / v[1];
-            double e2 = e[2] / v[2];
-            return vec3(e0, e1, e2);
+        inline vec3_t operator/(const vec3_t& v) const{
+            T e0 = e[0] / v[0];
+            T e1 = e[1] / v[1];
+            T e2 = e[2] / v[2];
+            return vec3_t(e0, e1, e2);
         }
 
-        inline double& operator[](int i) {
+        inline T& operator[](int i) {
             return e[i];
         }
 
-        inline double operator[](int i) const {
+        inline T operator[](int i) const {
             return e[i];
         }
 
-        inline double length() const {
+        inline T length() const {
             return std::sqrt(length_squared());
         }
 
-        inline double length_squared() const {
+        inline T length_squared() const {
             return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
         }
 
-        inline double max() const{
+        inline T max() const{
             return std::max(std::max(e[0], e[1]), e[2]);
         }
 
-        inline double mean() const{
+        inline T mean() const{
             return (e[0] + e[1] + e[2]) / 3.0;
         }
 
-        operator double*() const{
-            double* result = new double[3];
+        operator T*() const{
+            T* result = new T[3];
             result[0] = e[0];
             result[1] = e[1];
             result[2] = e[2];
@@ -129,39 +136,50 @@ class vec3 {
 };
 
 
-inline vec3 operator*(double value, const vec3& v) {
-    const double v0 = v[0] * value;
-    const double v1 = v[1] * value;
-    const double v2 = v[2] * value;
-    return vec3(v0, v1, v2);
+typedef vec3_t<double> vec3;
+typedef vec3_t<float> vec3f;
+
+
+template <class T>
+inline vec3_t<T> operator*(typename vec3_t<T>::scalar value, const vec3_t<T>& v) {
+    const T v0 = v[0] * value;
+    const T v1 = v[1] * value;
+    const T v2 = v[2] * value;
+    return vec3_t<T>(v0, v1, v2);
 }
 
 
-inline double dot_vectors(const vec3& v1, const vec3& v2){
+template <class T>
+inline T dot_vectors(const vec3_t<T>& v1, const vec3_t<T>& v2){
     return v1[0] * v2[0] + v1[1] * v2[1] + v1[2] * v2[2];
 }
 
 
-inline vec3 cross_vectors(const vec3& v1, const vec3& v2){
-    return vec3(v1[1] * v2[2] - v1[2] * v2[1], v1[2] * v2[0] - v1[0] * v2[2], v1[0] * v2[1] - v1[1] * v2[0]);
+template <class T>
+inline vec3_t<T> cross_vectors(const vec3_t<T>& v1, const vec3_t<T>& v2){
+    return vec3_t<T>(v1[1] * v2[2] - v1[2] * v2[1], v1[2] * v2[0] - v1[0] * v2[2], v1[0] * v2[1] - v1[1] * v2[0]);
 }
 
 
-inline vec3 normalize_vector(const vec3& v){
+template <class T>
+inline vec3_t<T> normalize_vector(const vec3_t<T>& v){
     return v / v.length();
 }
 
 
-inline vec3 exp_vector(const vec3& v){
-    return vec3(std::exp(v[0]), std::exp(v[1]), std::exp(v[2]));
+template <class T>
+inline vec3_t<T> exp_vector(const vec3_t<T>& v){
+    return vec3_t<T>(std::exp(v[0]), std::exp(v[1]), std::exp(v[2]));
 }
 
-inline vec3 abs(const vec3& v){
-    return vec3(std::abs(v[0]), std::abs(v[1]), std::abs(v[2]));
+template <class T>
+inline vec3_t<T> abs(const vec3_t<T>& v){
+    return vec3_t<T>(std::abs(v[0]), std::abs(v[1]), std::abs(v[2]));
 }
 
 
-inline int argmax(const vec3& v) {
+template <class T>
+inline int argmax(const vec3_t<T>& v) {
     int max_index = 0;
     if (v[1] > v[max_index]) {
         max_index = 1;
@@ -172,8 +190,9 @@ inline int argmax(const vec3& v) {
     return max_index;
 }
 
-inline vec3 permute(const vec3& v, const int idx1, const int idx2, const int idx3){
-    return vec3(v[idx1], v[idx2], v[idx3]);
+template <class T>
+inline vec3_t<T> permute(const vec3_t<T>& v, const int idx1, const int idx2, const int idx3){
+    return vec3_t<T>(v[idx1], v[idx2], v[idx3]);
 }
 void display_vector(const vec3& v);
 
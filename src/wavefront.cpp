@@ -0,0 +1,250 @@
+#include "wavefront.h"
+#include "integrator.h"
+
+
+WavefrontIntegrator::WavefrontIntegrator(const Scene& _scene, const int _batch_size) : scene(_scene){
+    batch_size = std::max(_batch_size, 1);
+    number_of_paths = 0;
+
+    pixel_indices.resize(batch_size);
+    sample_indices.resize(batch_size);
+    samplers.resize(batch_size);
+    medium_stacks = new MediumStack[batch_size];
+
+    ray_origins.resize(batch_size);
+    ray_directions.resize(batch_size);
+    ray_types.resize(batch_size);
+    depths.resize(batch_size);
+    throughputs.resize(batch_size);
+    colors.resize(batch_size);
+    saved_points.resize(batch_size);
+    scatter_pdfs.resize(batch_size);
+
+    hits.resize(batch_size);
+    scatter_distances.resize(batch_size);
+    scattered.resize(batch_size);
+    has_hit_surface.resize(batch_size);
+    shadow_ray_pending.resize(batch_size);
+    light_samples.resize(batch_size);
+    light_throughputs.resize(batch_size);
+    results.resize(batch_size);
+
+    active_paths.reserve(batch_size);
+    alive.resize(batch_size);
+}
+
+WavefrontIntegrator::~WavefrontIntegrator(){
+    delete[] medium_stacks;
+}
+
+
+void WavefrontIntegrator::render(const std::vector<PixelWork>& work, PixelAccumulator* accumulators){
+    // Expands the work into one path per sample. The sample indices are fixed up front, since a pixel can be split over
+    // several batches and its accumulator is only updated once a batch has finished.
+    path_pixels.clear();
+    path_samples.clear();
+    for (size_t i = 0; i < work.size(); i++){
+        int idx = work[i].pixel_index;
+        for (int j = 0; j < work[i].number_of_samples; j++){
+            path_pixels.push_back(idx);
+            path_samples.push_back(accumulators[idx].number_of_samples + j);
+        }
+    }
+
+    for (int first_path = 0; first_path < (int) path_pixels.size(); first_path += batch_size){
+        generate_camera_rays(first_path);
+        while (!active_paths.empty()){
+            find_closest_hits();
+            shade();
+            cast_shadow_rays();
+            sample_scattering();
+            russian_roulette_stage();
+        }
+
+        // Samples are added in the order they were generated, which gives the same sums as tracing them one by one.
+        for (int i = 0; i < number_of_paths; i++){
+            results[i].pixel_color = colors[i];
+            accumulators[pixel_indices[i]].add_sample(results[i]);
+        }
+    }
+}
+
+
+void WavefrontIntegrator::generate_camera_rays(const int first_path){
+    number_of_paths = std::min(batch_size, (int) path_pixels.size() - first_path);
+    active_paths.clear();
+    for (int i = 0; i < number_of_paths; i++){
+        int idx = path_pixels[first_path + i];
+        int x = idx % constants::WIDTH;
+        int y = constants::HEIGHT - idx / constants::WIDTH;
+        pixel_indices[i] = idx;
+        sample_indices[i] = path_samples[first_path + i];
+        samplers[i] = Sampler(idx, sample_indices[i]);
+
+        Ray ray = generate_camera_ray(*scene.camera, x, y, samplers[i]);
+        ray_origins[i] = ray.starting_position;
+        ray_directions[i] = ray.direction_vector;
+        ray_types[i] = ray.type;
+
+        medium_stacks[i].clear();
+        medium_stacks[i].add_medium(scene.medium, -1);
+        depths[i] = 0;
+        throughputs[i] = vec3(1,1,1);
+        colors[i] = vec3(0,0,0);
+        saved_points[i] = vec3(0,0,0);
+        scatter_pdfs[i] = 0;
+        has_hit_surface[i] = false;
+        results[i] = PixelData();
+        alive[i] = true;
+        active_paths.push_back(i);
+    }
+}
+
+
+void WavefrontIntegrator::find_closest_hits(){
+    // Paths that leave the scene without hitting anything or scattering pick up the environment and are terminated here.
+    for (size_t k = 0; k < active_paths.size(); k++){
+        int i = active_paths[k];
+        Medium* medium = medium_stacks[i].get_medium();
+        double scatter_distance = medium -> sample_distance(samplers[i]);
+
+        Ray ray;
+        ray.starting_position = ray_origins[i];
+        ray.direction_vector = ray_directions[i];
+        ray.type = ray_types[i];
+        ray.t_max = scatter_distance;
+        Hit ray_hit;
+        if (!scene.geometry -> find_closest_hit(ray_hit, ray)){
+            if (scatter_distance == constants::max_ray_distance){
+                vec3 transmittance = medium -> sample(scene.objects, scene.number_of_objects, scatter_distance, false);
+                colors[i] += environment_emission(ray.direction_vector, *scene.geometry, depths[i], ray_types[i], scatter_pdfs[i]) * transmittance * throughputs[i];
+                alive[i] = false;
+                continue;
+            }
+            ray_hit.distance = constants::max_ray_distance;
+        }
+
+        scattered[i] = scatter_distance < ray_hit.distance;
+        scatter_distances[i] = std::min(scatter_distance, ray_hit.distance);
+        hits[i] = ray_hit;
+    }
+    compact();
+}
+
+
+void WavefrontIntegrator::shade(){
+    // Applies the medium along the segment, adds emission from hit lights and prepares the light samples. Scattering
+    // paths also sample their new direction here, surface paths do so after their shadow rays have been traced.
+    for (size_t k = 0; k < active_paths.size(); k++){
+        int i = active_paths[k];
+        Medium* medium = medium_stacks[i].get_medium();
+        shadow_ray_pending[i] = false;
+
+        if (scattered[i]){
+            colors[i] += medium -> sample_emission() * throughputs[i];
+        }
+        throughputs[i] *= medium -> sample(scene.objects, scene.number_of_objects, scatter_distances[i], scattered[i]);
+
+        if (scattered[i]){
+            vec3 scatter_point = ray_origins[i] + ray_directions[i] * scatter_distances[i];
+            vec3 scattered_direction = medium -> sample_direction(ray_directions[i], samplers[i]);
+            if (constants::enable_next_event_estimation){
+                hits[i].intersection_point = scatter_point;
+                light_samples[i] = prepare_light_sample(hits[i], *scene.geometry, medium_stacks[i], true, samplers[i]);
+                light_throughputs[i] = throughputs[i];
+                shadow_ray_pending[i] = true;
+
+                ray_types[i] = DIFFUSE;
+                scatter_pdfs[i] = medium -> phase_function(ray_directions[i], scattered_direction);
+                saved_points[i] = scatter_point;
+            }
+
+            ray_origins[i] = scatter_point;
+            ray_directions[i] = scattered_direction;
+            continue;
+        }
+
+        const Hit& ray_hit = hits[i];
+        if (!has_hit_surface[i]){
+            results[i].pixel_position = ray_hit.intersection_point;
+            results[i].pixel_normal = ray_hit.normal_vector;
+            has_hit_surface[i] = true;
+        }
+
+        if (scene.objects[ray_hit.intersected_object_index] -> is_light_source()){
+            colors[i] += light_hit_emission(ray_hit, *scene.geometry, depths[i], ray_types[i], scatter_pdfs[i], saved_points[i]) * throughputs[i];
+        }
+
+        if (constants::enable_next_event_estimation){
+            light_samples[i] = prepare_light_sample(ray_hit, *scene.geometry, medium_stacks[i], false, samplers[i]);
+            light_throughputs[i] = throughputs[i];
+            shadow_ray_pending[i] = true;
+        }
+    }
+}
+
+
+void WavefrontIntegrator::cast_shadow_rays(){
+    // Runs before the medium stacks are updated, so the shadow rays start out in the medium of the shading point.
+    for (size_t k = 0; k < active_paths.size(); k++){
+        int i = active_paths[k];
+        if (!shadow_ray_pending[i]){
+            continue;
+        }
+        colors[i] += evaluate_light_sample(light_samples[i], *scene.geometry, medium_stacks[i]) * light_throughputs[i];
+    }
+}
+
+
+void WavefrontIntegrator::sample_scattering(){
+    for (size_t k = 0; k < active_paths.size(); k++){
+        int i = active_paths[k];
+        if (scattered[i]){
+            continue;
+        }
+        const Hit& ray_hit = hits[i];
+        Object* hit_object = scene.objects[ray_hit.intersected_object_index];
+
+        BrdfData brdf_result = hit_object -> sample(ray_hit, samplers[i]);
+        bool is_virtual_surface = hit_object -> get_material(ray_hit.primitive_ID) -> allow_direct_light();
+        if (is_virtual_surface){
+            brdf_result.type = ray_types[i];
+        }
+        else{
+            scatter_pdfs[i] = brdf_result.pdf;
+            saved_points[i] = ray_hit.intersection_point;
+        }
+        throughputs[i] *= brdf_result.brdf_over_pdf;
+
+        update_medium_stack(medium_stacks[i], ray_hit, hit_object, brdf_result.outgoing_vector);
+        ray_origins[i] = ray_hit.intersection_point;
+        ray_directions[i] = brdf_result.outgoing_vector;
+        ray_types[i] = brdf_result.type;
+    }
+}
+
+
+void WavefrontIntegrator::russian_roulette_stage(){
+    for (size_t k = 0; k < active_paths.size(); k++){
+        int i = active_paths[k];
+        if (!russian_roulette(throughputs[i], depths[i], samplers[i]) || depths[i] >= constants::max_recursion_depth){
+            alive[i] = false;
+            continue;
+        }
+        depths[i]++;
+    }
+    compact();
+}
+
+
+void WavefrontIntegrator::compact(){
+    // Removes terminated paths while keeping the remaining ones in order.
+    int number_of_active_paths = 0;
+    for (size_t k = 0; k < active_paths.size(); k++){
+        if (alive[active_paths[k]]){
+            active_paths[number_of_active_paths] = active_paths[k];
+            number_of_active_paths++;
+        }
+    }
+    active_paths.resize(number_of_active_paths);
+}
@@ -0,0 +1,71 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <vector>
+#include "vec3.h"
+#include "utils.h"
+#include "objects.h"
+#include "medium.h"
+#include "scene.h"
+#include "accumulator.h"
+
+
+struct PixelWork{
+    int pixel_index;
+    int number_of_samples;
+};
+
+
+class WavefrontIntegrator{
+    // Traces a batch of paths in lock step, one stage at a time, instead of following each path to the end. The path
+    // state is kept in structure-of-arrays form so that every stage is a tight loop over the active paths. One integrator
+    // can render any number of work lists in turn, every batch starts from freshly initialised path state.
+    public:
+        WavefrontIntegrator(const Scene& _scene, const int _batch_size);
+        ~WavefrontIntegrator();
+
+        void render(const std::vector<PixelWork>& work, PixelAccumulator* accumulators);
+
+    private:
+        const Scene& scene;
+        int batch_size;
+        int number_of_paths;
+
+        std::vector<int> path_pixels;
+        std::vector<int> path_samples;
+        std::vector<int> pixel_indices;
+        std::vector<int> sample_indices;
+        std::vector<Sampler> samplers;
+        MediumStack* medium_stacks;
+
+        std::vector<vec3> ray_origins;
+        std::vector<vec3> ray_directions;
+        std::vector<int> ray_types;
+        std::vector<int> depths;
+        std::vector<vec3> throughputs;
+        std::vector<vec3> colors;
+        std::vector<vec3> saved_points;
+        std::vector<double> scatter_pdfs;
+
+        std::vector<Hit> hits;
+        std::vector<double> scatter_distances;
+        std::vector<char> scattered;
+        std::vector<char> has_hit_surface;
+        std::vector<char> shadow_ray_pending;
+        std::vector<LightSample> light_samples;
+        std::vector<vec3> light_throughputs;
+        std::vector<PixelData> results;
+
+        std::vector<int> active_paths;
+        std::vector<char> alive;
+
+        void generate_camera_rays(const int first_path);
+        void find_closest_hits();
+        void shade();
+        void cast_shadow_rays();
+        void sample_scattering();
+        void russian_roulette_stage();
+        void compact();
+};
+
+#endif